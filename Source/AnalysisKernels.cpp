@@ -0,0 +1,400 @@
+#include "AnalysisKernels.h"
+#include "AnalysisKernelsSimd.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#if JUCE_INTEL
+#if JUCE_MSVC
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+using AnalysisKernelsSimd::KernelTable;
+using InstructionSet = AnalysisKernels::InstructionSet;
+
+namespace {
+// The loops the analysis ran before the vector paths existed, kept as the
+// reference they are checked against
+float scalarSumSquares(const float *const *channels, int numChannels,
+                       int start, int numSamples) {
+  float sum = 0.0f;
+  for (int c = 0; c < numChannels; ++c) {
+    const float *data = channels[c] + start;
+    for (int i = 0; i < numSamples; ++i)
+      sum += data[i] * data[i];
+  }
+  return sum;
+}
+
+float scalarDot(const float *a, const float *b, int numSamples) {
+  float sum = 0.0f;
+  for (int i = 0; i < numSamples; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+void scalarMinMax(const float *data, int numSamples, float &minimum,
+                  float &maximum) {
+  minimum = maximum = numSamples > 0 ? data[0] : 0.0f;
+  for (int i = 1; i < numSamples; ++i) {
+    minimum = std::min(minimum, data[i]);
+    maximum = std::max(maximum, data[i]);
+  }
+}
+
+void scalarDownmix(const float *const *channels, int numChannels, int start,
+                   int numSamples, float gain, float *destination) {
+  for (int i = 0; i < numSamples; ++i) {
+    float x = channels[0][start + i];
+    for (int c = 1; c < numChannels; ++c)
+      x += channels[c][start + i];
+    destination[i] = x * gain;
+  }
+}
+
+constexpr KernelTable scalarKernels{
+    {&scalarSumSquares, &scalarSumSquares, &scalarSumSquares},
+    &scalarDot,
+    &scalarMinMax,
+    {&scalarDownmix, &scalarDownmix, &scalarDownmix}};
+
+constexpr InstructionSet allInstructionSets[] = {
+    InstructionSet::scalar, InstructionSet::sse2, InstructionSet::avx2,
+    InstructionSet::avx512};
+
+// XCR0 bits for the register state each path needs: XMM and YMM for AVX2;
+// AVX-512 adds the opmask registers and both halves of the ZMM state
+constexpr juce::uint64 avxState = 0x06;
+constexpr juce::uint64 avx512State = 0xe6;
+
+// The CPUID flags only say the instructions exist. Unless the OS also saves
+// the wider registers on a context switch (OSXSAVE set, and the state
+// enabled in XCR0), using them faults, as under some VMs and older kernels.
+bool isStateEnabledByOS(juce::uint64 state) {
+#if JUCE_INTEL
+#if JUCE_MSVC
+  int info[4];
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0)
+    return false;
+  const auto enabled = (juce::uint64)_xgetbv(0);
+#else
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & (1u << 27)) == 0)
+    return false;
+  // Inline rather than _xgetbv(), which needs the whole unit built for XSAVE
+  unsigned int low, high;
+  __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+  const auto enabled = (juce::uint64)high << 32 | low;
+#endif
+  return (enabled & state) == state;
+#else
+  juce::ignoreUnused(state);
+  return false;
+#endif
+}
+
+// Null unless the CPU, the OS and this build all have the path
+const KernelTable *getKernelsFor(InstructionSet set) {
+  switch (set) {
+  case InstructionSet::sse2:
+    return juce::SystemStats::hasSSE2() ? AnalysisKernelsSimd::getSse2Kernels()
+                                        : nullptr;
+  case InstructionSet::avx2:
+    return juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3() &&
+                   isStateEnabledByOS(avxState)
+               ? AnalysisKernelsSimd::getAvx2Kernels()
+               : nullptr;
+  case InstructionSet::avx512:
+    return juce::SystemStats::hasAVX512F() && isStateEnabledByOS(avx512State)
+               ? AnalysisKernelsSimd::getAvx512Kernels()
+               : nullptr;
+  case InstructionSet::scalar:
+    break;
+  }
+  return &scalarKernels;
+}
+
+int getChannelVariant(int numChannels) {
+  return numChannels == 1 ? 0 : numChannels == 2 ? 1 : 2;
+}
+
+// Runs kernels and the reference over every length up to a few vectors
+// (so each tail size is hit), some longer ones, unaligned starts and one to
+// three channels. Sums may differ by rounding, relative to the sum of the
+// terms' magnitudes; everything else must match exactly.
+int checkAgainstReference(const KernelTable &kernels, const char *name) {
+  constexpr int maxChannels = 3, maxLength = 4099;
+  juce::Random random(42);
+  std::vector<float> data((size_t)maxChannels * (maxLength + 8));
+  for (auto &x : data)
+    x = random.nextFloat() * 2.0f - 1.0f;
+  const float *channels[maxChannels];
+  for (int c = 0; c < maxChannels; ++c)
+    channels[c] = data.data() + (size_t)c * (maxLength + 8);
+
+  std::vector<float> expected(maxLength), actual(maxLength);
+  int failures = 0;
+  auto check = [&](bool ok, const char *kernel, int numChannels, int start,
+                   int length) {
+    if (ok)
+      return;
+    ++failures;
+    if (name != nullptr)
+      std::cout << "  " << name << " " << kernel << " differs from scalar ("
+                << numChannels << " ch, start " << start << ", length "
+                << length << ")\n";
+  };
+
+  std::vector<int> lengths;
+  for (int length = 0; length <= 70; ++length)
+    lengths.push_back(length);
+  for (int length : {127, 128, 129, 1000, 4096, maxLength})
+    lengths.push_back(length);
+
+  for (int numChannels = 1; numChannels <= maxChannels; ++numChannels) {
+    const int variant = getChannelVariant(numChannels);
+    for (int start = 0; start < 4; ++start) {
+      for (int length : lengths) {
+        if (start + length > maxLength)
+          continue;
+
+        float magnitude = 0.0f;
+        for (int c = 0; c < numChannels; ++c)
+          for (int i = 0; i < length; ++i)
+            magnitude += channels[c][start + i] * channels[c][start + i];
+        const float tolerance = 1.0e-4f * (1.0f + magnitude);
+
+        const float squares = kernels.sumSquares[variant](
+            channels, numChannels, start, length);
+        check(std::abs(squares - scalarSumSquares(channels, numChannels,
+                                                  start, length)) <= tolerance,
+              "sumSquares", numChannels, start, length);
+
+        kernels.downmix[variant](channels, numChannels, start, length, 0.5f,
+                                 actual.data());
+        scalarDownmix(channels, numChannels, start, length, 0.5f,
+                      expected.data());
+        check(std::equal(actual.begin(), actual.begin() + length,
+                         expected.begin()),
+              "downmix", numChannels, start, length);
+
+        if (numChannels > 1)
+          continue;
+
+        const float *a = channels[0] + start, *b = channels[1] + start;
+        float dotMagnitude = 0.0f;
+        for (int i = 0; i < length; ++i)
+          dotMagnitude += std::abs(a[i] * b[i]);
+        check(std::abs(kernels.dot(a, b, length) - scalarDot(a, b, length)) <=
+                  1.0e-4f * (1.0f + dotMagnitude),
+              "dot", 1, start, length);
+
+        float minimum, maximum, expectedMinimum, expectedMaximum;
+        kernels.minMax(a, length, minimum, maximum);
+        scalarMinMax(a, length, expectedMinimum, expectedMaximum);
+        check(minimum == expectedMinimum && maximum == expectedMaximum,
+              "findMinAndMax", 1, start, length);
+      }
+    }
+  }
+  return failures;
+}
+
+// The widest supported path, chosen the first time any kernel runs
+struct Dispatch {
+  Dispatch() {
+    for (auto set : {InstructionSet::avx512, InstructionSet::avx2,
+                     InstructionSet::sse2}) {
+      if (auto *candidate = getKernelsFor(set)) {
+        kernels = candidate;
+        instructionSet = set;
+        break;
+      }
+    }
+
+#if JUCE_DEBUG
+    // A broken vector path would quietly skew every analysis
+    jassert(checkAgainstReference(*kernels.load(), nullptr) == 0);
+#endif
+  }
+
+  std::atomic<const KernelTable *> kernels{&scalarKernels};
+  std::atomic<InstructionSet> instructionSet{InstructionSet::scalar};
+};
+
+Dispatch &getDispatch() {
+  static Dispatch dispatch;
+  return dispatch;
+}
+
+const KernelTable &getKernels() {
+  return *getDispatch().kernels.load(std::memory_order_relaxed);
+}
+} // namespace
+
+float AnalysisKernels::sumSquares(const juce::AudioBuffer<float> &buffer,
+                                  int start, int numSamples) {
+  const int numChannels = buffer.getNumChannels();
+  if (numChannels == 0 || numSamples <= 0)
+    return 0.0f;
+  return getKernels().sumSquares[getChannelVariant(numChannels)](
+      buffer.getArrayOfReadPointers(), numChannels, start, numSamples);
+}
+
+float AnalysisKernels::dot(const float *a, const float *b, int numSamples) {
+  return numSamples > 0 ? getKernels().dot(a, b, numSamples) : 0.0f;
+}
+
+juce::Range<float> AnalysisKernels::findMinAndMax(const float *data,
+                                                  int numSamples) {
+  if (numSamples <= 0)
+    return {};
+
+  float minimum, maximum;
+  getKernels().minMax(data, numSamples, minimum, maximum);
+  return {minimum, maximum};
+}
+
+void AnalysisKernels::downmix(const juce::AudioBuffer<float> &buffer,
+                              int start, int numSamples, float gain,
+                              float *destination) {
+  const int numChannels = buffer.getNumChannels();
+  if (numChannels == 0 || numSamples <= 0)
+    return;
+  getKernels().downmix[getChannelVariant(numChannels)](
+      buffer.getArrayOfReadPointers(), numChannels, start, numSamples, gain,
+      destination);
+}
+
+AnalysisKernels::InstructionSet AnalysisKernels::getInstructionSet() {
+  return getDispatch().instructionSet;
+}
+
+bool AnalysisKernels::isSupported(InstructionSet set) {
+  return getKernelsFor(set) != nullptr;
+}
+
+bool AnalysisKernels::setInstructionSet(InstructionSet set) {
+  auto *kernels = getKernelsFor(set);
+  if (kernels == nullptr)
+    return false;
+
+  auto &dispatch = getDispatch();
+  dispatch.kernels = kernels;
+  dispatch.instructionSet = set;
+  return true;
+}
+
+const char *AnalysisKernels::getName(InstructionSet set) {
+  switch (set) {
+  case InstructionSet::sse2:
+    return "SSE2";
+  case InstructionSet::avx2:
+    return "AVX2";
+  case InstructionSet::avx512:
+    return "AVX-512";
+  case InstructionSet::scalar:
+    break;
+  }
+  return "scalar";
+}
+
+int AnalysisKernels::runBenchmark(double secondsPerKernel) {
+  const auto selected = getInstructionSet();
+  std::cout << "Analysis kernels: " << getName(selected) << " selected\n";
+
+  std::vector<InstructionSet> sets;
+  int failures = 0;
+  for (auto set : allInstructionSets) {
+    if (!isSupported(set)) {
+      std::cout << "  " << getName(set) << ": not available\n";
+      continue;
+    }
+    sets.push_back(set);
+    if (set == InstructionSet::scalar)
+      continue;
+
+    const int mismatches =
+        checkAgainstReference(*getKernelsFor(set), getName(set));
+    failures += mismatches;
+    std::cout << "  " << getName(set) << ": "
+              << (mismatches == 0 ? "matches scalar" : "MISMATCH") << "\n";
+  }
+
+  // A block the size of an analysis window that stays in cache, so the
+  // figures are compute throughput
+  constexpr int blockSize = 4096;
+  juce::AudioBuffer<float> block(2, blockSize);
+  juce::AudioBuffer<float> mono(1, blockSize);
+  juce::Random random(7);
+  for (int c = 0; c < 2; ++c)
+    for (int i = 0; i < blockSize; ++i)
+      block.setSample(c, i, random.nextFloat() * 2.0f - 1.0f);
+  mono.copyFrom(0, 0, block, 0, 0, blockSize);
+  std::vector<float> destination(blockSize);
+  volatile float sink = 0.0f;
+
+  struct Benchmark {
+    const char *name;
+    int samplesPerCall; // Counting every channel's samples
+    std::function<void()> call;
+  };
+  const Benchmark benchmarks[] = {
+      {"sumSquares mono", blockSize,
+       [&] { sink = sink + sumSquares(mono, 0, blockSize); }},
+      {"sumSquares stereo", 2 * blockSize,
+       [&] { sink = sink + sumSquares(block, 0, blockSize); }},
+      {"dot", blockSize,
+       [&] {
+         sink = sink + dot(block.getReadPointer(0), block.getReadPointer(1),
+                           blockSize);
+       }},
+      {"findMinAndMax", blockSize,
+       [&] {
+         sink = sink +
+                findMinAndMax(block.getReadPointer(0), blockSize).getEnd();
+       }},
+      {"downmix stereo", 2 * blockSize, [&] {
+         downmix(block, 0, blockSize, 0.5f, destination.data());
+         sink = sink + destination[0];
+       }}};
+
+  std::cout << "\nThroughput in Msamples/s (" << blockSize
+            << "-sample blocks)\n"
+            << juce::String("kernel").paddedRight(' ', 20);
+  for (auto set : sets)
+    std::cout << juce::String(getName(set)).paddedLeft(' ', 10);
+  std::cout << "\n";
+
+  for (auto &benchmark : benchmarks) {
+    std::cout << juce::String(benchmark.name).paddedRight(' ', 20);
+    for (auto set : sets) {
+      setInstructionSet(set);
+      juce::int64 calls = 0;
+      const double startMs = juce::Time::getMillisecondCounterHiRes();
+      double elapsedMs = 0.0;
+      do {
+        for (int i = 0; i < 64; ++i)
+          benchmark.call();
+        calls += 64;
+        elapsedMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+      } while (elapsedMs < secondsPerKernel * 1000.0);
+
+      const double rate =
+          (double)calls * benchmark.samplesPerCall / (elapsedMs * 1000.0);
+      std::cout << juce::String(rate, 0).paddedLeft(' ', 10);
+    }
+    std::cout << "\n";
+  }
+
+  setInstructionSet(selected);
+  std::cout << std::flush;
+  return failures;
+}
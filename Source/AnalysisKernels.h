@@ -0,0 +1,36 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// The analysis' hot inner loops. Each has a plain scalar reference plus
+// SSE2, AVX2 and AVX-512 builds specialised for mono and stereo; the widest
+// one the CPU supports is picked the first time any kernel is used.
+// Vector paths sum in a different order, so results can differ from the
+// reference in the last few bits.
+class AnalysisKernels {
+public:
+  enum class InstructionSet { scalar, sse2, avx2, avx512 };
+
+  // Sum of x^2 over every channel of [start, start + numSamples)
+  static float sumSquares(const juce::AudioBuffer<float> &buffer, int start,
+                          int numSamples);
+  static float dot(const float *a, const float *b, int numSamples);
+  static juce::Range<float> findMinAndMax(const float *data, int numSamples);
+  // destination = gain * (sum of every channel of [start, start + numSamples))
+  static void downmix(const juce::AudioBuffer<float> &buffer, int start,
+                      int numSamples, float gain, float *destination);
+
+  static InstructionSet getInstructionSet();
+  static bool isSupported(InstructionSet set);
+  // Returns false, leaving the current choice, if the CPU or build lacks it
+  static bool setInstructionSet(InstructionSet set);
+  static const char *getName(InstructionSet set);
+
+  // Compares every supported instruction set with the scalar reference over
+  // awkward lengths and alignments, then prints each kernel's throughput.
+  // Returns the number of mismatches.
+  static int runBenchmark(double secondsPerKernel);
+
+private:
+  AnalysisKernels() = delete;
+};
@@ -0,0 +1,55 @@
+#include "AnalysisKernelsSimd.h"
+
+// Built with AVX2 and FMA enabled for this file only (see CMakeLists.txt)
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#include <immintrin.h>
+
+namespace {
+struct Avx2 {
+  using Vector = __m256;
+  static constexpr int width = 8;
+
+  static Vector zero() { return _mm256_setzero_ps(); }
+  static Vector broadcast(float x) { return _mm256_set1_ps(x); }
+  static Vector load(const float *p) { return _mm256_loadu_ps(p); }
+  static void store(float *p, Vector x) { _mm256_storeu_ps(p, x); }
+  static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+  static Vector multiply(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+  static Vector multiplyAdd(Vector a, Vector b, Vector acc) {
+    return _mm256_fmadd_ps(a, b, acc);
+  }
+  static Vector min(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+  static Vector max(Vector a, Vector b) { return _mm256_max_ps(a, b); }
+
+  // Fold the two halves together, then finish as SSE
+  static float sum(Vector x) {
+    __m128 y = _mm_add_ps(_mm256_castps256_ps128(x),
+                          _mm256_extractf128_ps(x, 1));
+    y = _mm_add_ps(y, _mm_movehl_ps(y, y));
+    return _mm_cvtss_f32(_mm_add_ss(y, _mm_shuffle_ps(y, y, 1)));
+  }
+  static float lowest(Vector x) {
+    __m128 y = _mm_min_ps(_mm256_castps256_ps128(x),
+                          _mm256_extractf128_ps(x, 1));
+    y = _mm_min_ps(y, _mm_movehl_ps(y, y));
+    return _mm_cvtss_f32(_mm_min_ss(y, _mm_shuffle_ps(y, y, 1)));
+  }
+  static float highest(Vector x) {
+    __m128 y = _mm_max_ps(_mm256_castps256_ps128(x),
+                          _mm256_extractf128_ps(x, 1));
+    y = _mm_max_ps(y, _mm_movehl_ps(y, y));
+    return _mm_cvtss_f32(_mm_max_ss(y, _mm_shuffle_ps(y, y, 1)));
+  }
+};
+
+constexpr auto kernels = AnalysisKernelsSimd::makeKernelTable<Avx2>();
+} // namespace
+
+const AnalysisKernelsSimd::KernelTable *AnalysisKernelsSimd::getAvx2Kernels() {
+  return &kernels;
+}
+#else
+const AnalysisKernelsSimd::KernelTable *AnalysisKernelsSimd::getAvx2Kernels() {
+  return nullptr;
+}
+#endif
@@ -0,0 +1,41 @@
+#include "AnalysisKernelsSimd.h"
+
+// Built with AVX-512F enabled for this file only (see CMakeLists.txt)
+#if defined(__AVX512F__)
+#include <immintrin.h>
+
+namespace {
+struct Avx512 {
+  using Vector = __m512;
+  static constexpr int width = 16;
+
+  static Vector zero() { return _mm512_setzero_ps(); }
+  static Vector broadcast(float x) { return _mm512_set1_ps(x); }
+  static Vector load(const float *p) { return _mm512_loadu_ps(p); }
+  static void store(float *p, Vector x) { _mm512_storeu_ps(p, x); }
+  static Vector add(Vector a, Vector b) { return _mm512_add_ps(a, b); }
+  static Vector multiply(Vector a, Vector b) { return _mm512_mul_ps(a, b); }
+  static Vector multiplyAdd(Vector a, Vector b, Vector acc) {
+    return _mm512_fmadd_ps(a, b, acc);
+  }
+  static Vector min(Vector a, Vector b) { return _mm512_min_ps(a, b); }
+  static Vector max(Vector a, Vector b) { return _mm512_max_ps(a, b); }
+
+  static float sum(Vector x) { return _mm512_reduce_add_ps(x); }
+  static float lowest(Vector x) { return _mm512_reduce_min_ps(x); }
+  static float highest(Vector x) { return _mm512_reduce_max_ps(x); }
+};
+
+constexpr auto kernels = AnalysisKernelsSimd::makeKernelTable<Avx512>();
+} // namespace
+
+const AnalysisKernelsSimd::KernelTable *
+AnalysisKernelsSimd::getAvx512Kernels() {
+  return &kernels;
+}
+#else
+const AnalysisKernelsSimd::KernelTable *
+AnalysisKernelsSimd::getAvx512Kernels() {
+  return nullptr;
+}
+#endif
@@ -0,0 +1,183 @@
+#pragma once
+
+// Internal to AnalysisKernels. The vector kernels are written once against
+// an Ops struct (load, add, multiplyAdd, reductions, ...) and instantiated in
+// one translation unit per instruction set, each compiled with its own
+// target flags. Those units include nothing from JUCE or the standard
+// library, and their Ops live in anonymous namespaces, so no inline code
+// built for a wider instruction set can leak into the rest of the program.
+
+namespace AnalysisKernelsSimd {
+
+struct KernelTable {
+  using SumSquares = float (*)(const float *const *channels, int numChannels,
+                               int start, int numSamples);
+  using Dot = float (*)(const float *a, const float *b, int numSamples);
+  using MinMax = void (*)(const float *data, int numSamples, float &minimum,
+                          float &maximum);
+  using Downmix = void (*)(const float *const *channels, int numChannels,
+                           int start, int numSamples, float gain,
+                           float *destination);
+
+  // Indexed mono, stereo, any channel count
+  SumSquares sumSquares[3];
+  Dot dot;
+  MinMax minMax;
+  Downmix downmix[3];
+};
+
+// Null when this build has no such path (other architectures or compilers)
+const KernelTable *getSse2Kernels();
+const KernelTable *getAvx2Kernels();
+const KernelTable *getAvx512Kernels();
+
+// Four independent accumulators hide the add latency; the tail that does not
+// fill a vector is done one sample at a time
+template <typename Ops> float sumOfSquares(const float *data, int numSamples) {
+  constexpr int width = Ops::width;
+  auto acc0 = Ops::zero(), acc1 = Ops::zero(), acc2 = Ops::zero(),
+       acc3 = Ops::zero();
+  int i = 0;
+  for (; i + 4 * width <= numSamples; i += 4 * width) {
+    const auto x0 = Ops::load(data + i), x1 = Ops::load(data + i + width),
+               x2 = Ops::load(data + i + 2 * width),
+               x3 = Ops::load(data + i + 3 * width);
+    acc0 = Ops::multiplyAdd(x0, x0, acc0);
+    acc1 = Ops::multiplyAdd(x1, x1, acc1);
+    acc2 = Ops::multiplyAdd(x2, x2, acc2);
+    acc3 = Ops::multiplyAdd(x3, x3, acc3);
+  }
+  for (; i + width <= numSamples; i += width) {
+    const auto x = Ops::load(data + i);
+    acc0 = Ops::multiplyAdd(x, x, acc0);
+  }
+
+  float sum = Ops::sum(Ops::add(Ops::add(acc0, acc1), Ops::add(acc2, acc3)));
+  for (; i < numSamples; ++i)
+    sum += data[i] * data[i];
+  return sum;
+}
+
+template <typename Ops, int Channels>
+float sumSquares(const float *const *channels, int numChannels, int start,
+                 int numSamples) {
+  if constexpr (Channels == 1) {
+    return sumOfSquares<Ops>(channels[0] + start, numSamples);
+  } else if constexpr (Channels == 2) {
+    // Both channels in one pass
+    constexpr int width = Ops::width;
+    const float *left = channels[0] + start, *right = channels[1] + start;
+    auto acc0 = Ops::zero(), acc1 = Ops::zero(), acc2 = Ops::zero(),
+         acc3 = Ops::zero();
+    int i = 0;
+    for (; i + 2 * width <= numSamples; i += 2 * width) {
+      const auto l0 = Ops::load(left + i), l1 = Ops::load(left + i + width);
+      const auto r0 = Ops::load(right + i), r1 = Ops::load(right + i + width);
+      acc0 = Ops::multiplyAdd(l0, l0, acc0);
+      acc1 = Ops::multiplyAdd(r0, r0, acc1);
+      acc2 = Ops::multiplyAdd(l1, l1, acc2);
+      acc3 = Ops::multiplyAdd(r1, r1, acc3);
+    }
+
+    float sum = Ops::sum(Ops::add(Ops::add(acc0, acc1), Ops::add(acc2, acc3)));
+    for (; i < numSamples; ++i)
+      sum += left[i] * left[i] + right[i] * right[i];
+    return sum;
+  } else {
+    float sum = 0.0f;
+    for (int c = 0; c < numChannels; ++c)
+      sum += sumOfSquares<Ops>(channels[c] + start, numSamples);
+    return sum;
+  }
+}
+
+template <typename Ops>
+float dot(const float *a, const float *b, int numSamples) {
+  constexpr int width = Ops::width;
+  auto acc0 = Ops::zero(), acc1 = Ops::zero(), acc2 = Ops::zero(),
+       acc3 = Ops::zero();
+  int i = 0;
+  for (; i + 4 * width <= numSamples; i += 4 * width) {
+    acc0 = Ops::multiplyAdd(Ops::load(a + i), Ops::load(b + i), acc0);
+    acc1 = Ops::multiplyAdd(Ops::load(a + i + width),
+                            Ops::load(b + i + width), acc1);
+    acc2 = Ops::multiplyAdd(Ops::load(a + i + 2 * width),
+                            Ops::load(b + i + 2 * width), acc2);
+    acc3 = Ops::multiplyAdd(Ops::load(a + i + 3 * width),
+                            Ops::load(b + i + 3 * width), acc3);
+  }
+  for (; i + width <= numSamples; i += width)
+    acc0 = Ops::multiplyAdd(Ops::load(a + i), Ops::load(b + i), acc0);
+
+  float sum = Ops::sum(Ops::add(Ops::add(acc0, acc1), Ops::add(acc2, acc3)));
+  for (; i < numSamples; ++i)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+template <typename Ops>
+void minMax(const float *data, int numSamples, float &minimum,
+            float &maximum) {
+  constexpr int width = Ops::width;
+  if (numSamples < width) {
+    minimum = maximum = numSamples > 0 ? data[0] : 0.0f;
+    for (int i = 1; i < numSamples; ++i) {
+      minimum = data[i] < minimum ? data[i] : minimum;
+      maximum = data[i] > maximum ? data[i] : maximum;
+    }
+    return;
+  }
+
+  auto low0 = Ops::load(data), high0 = low0, low1 = low0, high1 = low0;
+  int i = width;
+  for (; i + 2 * width <= numSamples; i += 2 * width) {
+    const auto x0 = Ops::load(data + i), x1 = Ops::load(data + i + width);
+    low0 = Ops::min(low0, x0);
+    high0 = Ops::max(high0, x0);
+    low1 = Ops::min(low1, x1);
+    high1 = Ops::max(high1, x1);
+  }
+  for (; i + width <= numSamples; i += width) {
+    const auto x = Ops::load(data + i);
+    low0 = Ops::min(low0, x);
+    high0 = Ops::max(high0, x);
+  }
+  // The last vector may overlap ones already seen, which is harmless here
+  const auto last = Ops::load(data + numSamples - width);
+  minimum = Ops::lowest(Ops::min(Ops::min(low0, low1), last));
+  maximum = Ops::highest(Ops::max(Ops::max(high0, high1), last));
+}
+
+template <typename Ops, int Channels>
+void downmix(const float *const *channels, int numChannels, int start,
+             int numSamples, float gain, float *destination) {
+  constexpr int width = Ops::width;
+  const auto gainVector = Ops::broadcast(gain);
+  int i = 0;
+  for (; i + width <= numSamples; i += width) {
+    auto x = Ops::load(channels[0] + start + i);
+    if constexpr (Channels == 2) {
+      x = Ops::add(x, Ops::load(channels[1] + start + i));
+    } else if constexpr (Channels != 1) {
+      for (int c = 1; c < numChannels; ++c)
+        x = Ops::add(x, Ops::load(channels[c] + start + i));
+    }
+    Ops::store(destination + i, Ops::multiply(x, gainVector));
+  }
+
+  for (; i < numSamples; ++i) {
+    float x = channels[0][start + i];
+    for (int c = 1; c < (Channels == 0 ? numChannels : Channels); ++c)
+      x += channels[c][start + i];
+    destination[i] = x * gain;
+  }
+}
+
+template <typename Ops> constexpr KernelTable makeKernelTable() {
+  return {{&sumSquares<Ops, 1>, &sumSquares<Ops, 2>, &sumSquares<Ops, 0>},
+          &dot<Ops>,
+          &minMax<Ops>,
+          {&downmix<Ops, 1>, &downmix<Ops, 2>, &downmix<Ops, 0>}};
+}
+
+} // namespace AnalysisKernelsSimd
@@ -0,0 +1,49 @@
+#include "AnalysisKernelsSimd.h"
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+namespace {
+struct Sse2 {
+  using Vector = __m128;
+  static constexpr int width = 4;
+
+  static Vector zero() { return _mm_setzero_ps(); }
+  static Vector broadcast(float x) { return _mm_set1_ps(x); }
+  static Vector load(const float *p) { return _mm_loadu_ps(p); }
+  static void store(float *p, Vector x) { _mm_storeu_ps(p, x); }
+  static Vector add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+  static Vector multiply(Vector a, Vector b) { return _mm_mul_ps(a, b); }
+  // No fused multiply-add before AVX2
+  static Vector multiplyAdd(Vector a, Vector b, Vector acc) {
+    return _mm_add_ps(_mm_mul_ps(a, b), acc);
+  }
+  static Vector min(Vector a, Vector b) { return _mm_min_ps(a, b); }
+  static Vector max(Vector a, Vector b) { return _mm_max_ps(a, b); }
+
+  static float sum(Vector x) {
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    return _mm_cvtss_f32(_mm_add_ss(x, _mm_shuffle_ps(x, x, 1)));
+  }
+  static float lowest(Vector x) {
+    x = _mm_min_ps(x, _mm_movehl_ps(x, x));
+    return _mm_cvtss_f32(_mm_min_ss(x, _mm_shuffle_ps(x, x, 1)));
+  }
+  static float highest(Vector x) {
+    x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+    return _mm_cvtss_f32(_mm_max_ss(x, _mm_shuffle_ps(x, x, 1)));
+  }
+};
+
+constexpr auto kernels = AnalysisKernelsSimd::makeKernelTable<Sse2>();
+} // namespace
+
+const AnalysisKernelsSimd::KernelTable *AnalysisKernelsSimd::getSse2Kernels() {
+  return &kernels;
+}
+#else
+const AnalysisKernelsSimd::KernelTable *AnalysisKernelsSimd::getSse2Kernels() {
+  return nullptr;
+}
+#endif
@@ -0,0 +1,133 @@
+#include "AnalysisWorkspace.h"
+#include "AudioAnalysis.h"
+#include "Parallel.h"
+#include <cmath>
+
+void AnalysisWorkspace::prepare(int numSamples, double sampleRate) {
+  if (sampleRate <= 0 || numSamples <= 0)
+    return;
+
+  const int hopSize =
+      juce::jmax(1, (int)(AudioAnalysis::hopSeconds * sampleRate));
+  const auto numFrames = (size_t)(numSamples / hopSize + 1);
+  const auto numWindows =
+      numFrames / (size_t)AudioAnalysis::tempoWindowStepFrames + 1;
+  const auto maxLag = (size_t)AudioAnalysis::maxTempoLag + 1;
+
+  // reserve() never shrinks, so the workspace settles at the largest size
+  odf.reserve(numFrames);
+  pitchAc.reserve((size_t)AudioAnalysis::pitchWindowSamples);
+
+  lagScratch.resize((size_t)ParallelPool::getInstance().getNumWorkers());
+  for (auto &scratch : lagScratch) {
+    scratch.acResult.reserve(maxLag);
+    scratch.peaks.reserve(maxLag);
+  }
+
+  const int fftSize = 1 << AudioAnalysis::fluxFftOrder;
+  const auto numFluxFrames =
+      (size_t)(numSamples / AudioAnalysis::fluxHopSize + 1);
+
+  if (fluxWindow.empty()) {
+    // Periodic Hann window
+    fluxWindow.resize((size_t)fftSize);
+    for (int i = 0; i < fftSize; ++i)
+      fluxWindow[(size_t)i] =
+          0.5f - 0.5f * std::cos(juce::MathConstants<float>::twoPi * (float)i /
+                                 (float)fftSize);
+  }
+
+  fluxScratch.resize(lagScratch.size());
+  for (auto &scratch : fluxScratch) {
+    if (scratch.fft == nullptr)
+      scratch.fft =
+          std::make_unique<juce::dsp::FFT>(AudioAnalysis::fluxFftOrder);
+    scratch.fftData.resize((size_t)fftSize * 2);
+    scratch.previous.resize((size_t)fftSize / 2 + 1);
+    scratch.current.resize((size_t)fftSize / 2 + 1);
+  }
+
+  sliceScratch.resize(lagScratch.size());
+  for (auto &scratch : sliceScratch) {
+    scratch.mono.resize((size_t)AudioAnalysis::slicePitchWindowSamples);
+    scratch.pitchAc.resize((size_t)AudioAnalysis::slicePitchWindowSamples);
+    scratch.spectrum.resize((size_t)fftSize / 2 + 1);
+    scratch.melSum.resize((size_t)AudioAnalysis::numMelBands);
+  }
+
+  if (sampleRate != melSampleRate)
+    prepareMelFilterbank(sampleRate);
+
+  bandFlux.reserve(numFluxFrames * (size_t)AudioAnalysis::numFluxBands);
+  fluxOdf.reserve(numFluxFrames);
+
+  windowLags.reserve(numWindows);
+  smoothedLags.reserve(numWindows);
+  framePeriods.reserve(numFrames);
+  score.reserve(numFrames);
+  backlink.reserve(numFrames);
+  beatFrames.reserve(numFrames);
+  rawTempos.reserve(numFrames);
+}
+
+void AnalysisWorkspace::prepareMelFilterbank(double sampleRate) {
+  melSampleRate = sampleRate;
+
+  constexpr int numBands = AudioAnalysis::numMelBands;
+  const int fftSize = 1 << AudioAnalysis::fluxFftOrder;
+  const int numBins = fftSize / 2 + 1;
+  const double binHz = sampleRate / fftSize;
+
+  auto hzToMel = [](double hz) { return 2595.0 * std::log10(1.0 + hz / 700.0); };
+  auto melToHz = [](double mel) {
+    return 700.0 * (std::pow(10.0, mel / 2595.0) - 1.0);
+  };
+
+  // Triangular filters evenly spaced on the mel scale from 30Hz to 16kHz
+  const double lowMel = hzToMel(30.0);
+  const double highMel = hzToMel(std::min(16000.0, sampleRate * 0.5));
+  auto edgeHz = [&](int point) {
+    return melToHz(lowMel + (highMel - lowMel) * point / (numBands + 1));
+  };
+
+  melFirstBin.assign((size_t)numBands, 0);
+  melNumBins.assign((size_t)numBands, 0);
+  melWeightOffset.assign((size_t)numBands, 0);
+  melWeights.clear();
+
+  for (int band = 0; band < numBands; ++band) {
+    const double lower = edgeHz(band), centre = edgeHz(band + 1),
+                 upper = edgeHz(band + 2);
+    const int first = juce::jlimit(0, numBins - 1, (int)std::ceil(lower / binHz));
+    const int last = juce::jlimit(first, numBins - 1, (int)(upper / binHz));
+
+    melFirstBin[(size_t)band] = first;
+    melWeightOffset[(size_t)band] = (int)melWeights.size();
+
+    for (int bin = first; bin <= last; ++bin) {
+      const double hz = bin * binHz;
+      const double weight = hz <= centre ? (hz - lower) / (centre - lower)
+                                         : (upper - hz) / (upper - centre);
+      melWeights.push_back((float)juce::jmax(0.0, weight));
+    }
+
+    // Low bands narrower than a bin still take their nearest bin
+    if (melWeights.size() == (size_t)melWeightOffset[(size_t)band]) {
+      melFirstBin[(size_t)band] =
+          juce::jlimit(0, numBins - 1, (int)std::round(centre / binHz));
+      melWeights.push_back(1.0f);
+    }
+
+    melNumBins[(size_t)band] =
+        (int)melWeights.size() - melWeightOffset[(size_t)band];
+  }
+
+  // Orthonormal DCT-II rows for c1..c16
+  dctTable.resize((size_t)AudioAnalysis::fingerprintSize * numBands);
+  for (int c = 0; c < AudioAnalysis::fingerprintSize; ++c)
+    for (int band = 0; band < numBands; ++band)
+      dctTable[(size_t)(c * numBands + band)] =
+          (float)(std::sqrt(2.0 / numBands) *
+                  std::cos(juce::MathConstants<double>::pi * (c + 1) *
+                           (band + 0.5) / numBands));
+}
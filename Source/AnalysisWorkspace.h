@@ -0,0 +1,82 @@
+#pragma once
+
+#include "RunningMedian.h"
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+// Owns every scratch buffer used by AudioAnalysis. prepare() sizes it up
+// front for the longest buffer seen so far, so analysing that many samples
+// or fewer never touches the heap again. A workspace serves one analysis at
+// a time but can be handed between threads, e.g. one per batch worker.
+class AnalysisWorkspace {
+public:
+  AnalysisWorkspace() = default;
+
+  void prepare(int numSamples, double sampleRate);
+
+private:
+  friend class AudioAnalysis;
+
+  void prepareMelFilterbank(double sampleRate);
+
+  struct Peak {
+    int lag;
+    float value;
+  };
+
+  // Autocorrelation scratch, one per ParallelPool worker
+  struct LagScratch {
+    std::vector<float> acResult;
+    std::vector<Peak> peaks;
+  };
+
+  // STFT scratch for the spectral flux engine and the slice spectra, one per
+  // ParallelPool worker. Each has its own FFT: JUCE's fallback engine locks
+  // inside perform(), so a shared one would run the workers one at a time.
+  struct FluxScratch {
+    std::unique_ptr<juce::dsp::FFT> fft;
+    std::vector<float> fftData;
+    std::vector<float> previous;
+    std::vector<float> current;
+  };
+
+  // Per-slice feature scratch, one per ParallelPool worker
+  struct SliceScratch {
+    std::vector<float> mono;
+    std::vector<float> pitchAc;
+    std::vector<float> spectrum;
+    std::vector<float> melSum;
+  };
+
+  std::vector<float> odf;
+  std::vector<float> pitchAc;
+  std::vector<LagScratch> lagScratch;
+
+  // Spectral flux onsets
+  std::vector<float> fluxWindow;
+  std::vector<FluxScratch> fluxScratch;
+  std::vector<float> bandFlux; // frame * numFluxBands + band
+  std::vector<float> fluxOdf;
+  RunningMedian fluxMedian;
+
+  std::vector<SliceScratch> sliceScratch;
+
+  // Mel filterbank over the flux FFT bins and the DCT for the fingerprint,
+  // rebuilt whenever the sample rate changes
+  double melSampleRate = 0.0;
+  std::vector<int> melFirstBin, melNumBins, melWeightOffset;
+  std::vector<float> melWeights;
+  std::vector<float> dctTable; // fingerprintSize * numMelBands
+
+  // Tempo map
+  std::vector<double> windowLags;
+  std::vector<double> smoothedLags;
+  std::vector<double> framePeriods;
+  std::vector<float> score;
+  std::vector<int> backlink;
+  std::vector<int> beatFrames;
+  std::vector<double> rawTempos;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AnalysisWorkspace)
+};
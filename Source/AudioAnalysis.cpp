@@ -1,113 +1,334 @@
 #include "AudioAnalysis.h"
+#include "AnalysisKernels.h"
+#include "Parallel.h"
+#include "Tracing.h"
 #include <algorithm>
 #include <cmath>
+#include <iostream>
 #include <numeric>
 
+namespace {
+AnalysisWorkspace &getThreadWorkspace() {
+  static thread_local AnalysisWorkspace workspace;
+  return workspace;
+}
+
+struct Biquad {
+  double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+  double z1 = 0.0, z2 = 0.0;
+
+  float process(float x) {
+    const double y = b0 * x + z1;
+    z1 = b1 * x - a1 * y + z2;
+    z2 = b2 * x - a2 * y;
+    return (float)y;
+  }
+};
+
+// ITU-R BS.1770 K-weighting: the head-related high shelf followed by the RLB
+// high-pass, with both re-derived for the given sample rate
+void makeKWeighting(double sampleRate, Biquad &shelf, Biquad &highPass) {
+  {
+    const double f0 = 1681.974450955533, gainDb = 3.999843853973347,
+                 q = 0.7071752369554196;
+    const double k = std::tan(juce::MathConstants<double>::pi * f0 / sampleRate);
+    const double vh = std::pow(10.0, gainDb / 20.0);
+    const double vb = std::pow(vh, 0.4996667741545416);
+    const double a0 = 1.0 + k / q + k * k;
+    shelf.b0 = (vh + vb * k / q + k * k) / a0;
+    shelf.b1 = 2.0 * (k * k - vh) / a0;
+    shelf.b2 = (vh - vb * k / q + k * k) / a0;
+    shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+    shelf.a2 = (1.0 - k / q + k * k) / a0;
+  }
+  {
+    const double f0 = 38.13547087602444, q = 0.5003270373238773;
+    const double k = std::tan(juce::MathConstants<double>::pi * f0 / sampleRate);
+    const double a0 = 1.0 + k / q + k * k;
+    highPass.b0 = 1.0;
+    highPass.b1 = -2.0;
+    highPass.b2 = 1.0;
+    highPass.a1 = 2.0 * (k * k - 1.0) / a0;
+    highPass.a2 = (1.0 - k / q + k * k) / a0;
+  }
+}
+} // namespace
+
 AudioAnalysis::AnalysisResults
 AudioAnalysis::analyze(const juce::AudioBuffer<float> &buffer,
                        double sampleRate) {
+  return analyze(buffer, sampleRate, Options());
+}
+
+AudioAnalysis::AnalysisResults
+AudioAnalysis::analyze(const juce::AudioBuffer<float> &buffer,
+                       double sampleRate, const Options &options) {
   AnalysisResults results;
+  analyze(buffer, sampleRate, options, getThreadWorkspace(), results);
+  return results;
+}
 
-  results.onsets = findOnsets(buffer, sampleRate);
+void AudioAnalysis::analyze(const juce::AudioBuffer<float> &buffer,
+                            double sampleRate, const Options &options,
+                            AnalysisWorkspace &workspace,
+                            AnalysisResults &results) {
+  SAMPLER_TRACE_SCOPE("analyze", buffer.getNumSamples());
 
-  // Detect BPM using ODF and Autocorrelation
-  results.bpm = detectBPM(buffer, sampleRate);
+  results.bpm = 0.0;
+  results.frequency = 0.0;
+  results.onsets.clear();
+  results.beats.clear();
+  results.beatTempos.clear();
+  results.slices.resize(0);
 
-  results.frequency = detectFrequency(buffer, sampleRate);
+  if (sampleRate <= 0)
+    return;
 
-  return results;
+  workspace.prepare(buffer.getNumSamples(), sampleRate);
+
+  if (options.onsetEngine == OnsetEngine::spectralFlux)
+    findOnsetsSpectralFlux(buffer, sampleRate, workspace, results.onsets);
+  else
+    findOnsets(buffer, sampleRate, results.onsets);
+
+  // Detect BPM using ODF and Autocorrelation. The ODF is shared with the
+  // tempo map so it is only computed once.
+  if (buffer.getNumSamples() >= 1024) {
+    const int hopSize = (int)(hopSeconds * sampleRate);
+    computeODF(buffer, hopSize, workspace.odf);
+
+    results.bpm = detectBPM(workspace);
+
+    if (options.tempoMap)
+      detectTempoMap(workspace, hopSize, sampleRate, results);
+  }
+
+  results.frequency = detectFrequency(buffer, sampleRate, workspace);
+
+  computeSliceFeatures(buffer, sampleRate, results.onsets, workspace,
+                       results.slices);
 }
 
-std::vector<int>
-AudioAnalysis::findOnsets(const juce::AudioBuffer<float> &buffer,
-                          double sampleRate) {
-  std::vector<int> onsets;
+void AudioAnalysis::findOnsets(const juce::AudioBuffer<float> &buffer,
+                               double sampleRate, std::vector<int> &onsets) {
+  SAMPLER_TRACE_SCOPE("findOnsets", buffer.getNumSamples());
+  onsets.clear();
   if (sampleRate <= 0)
-    return onsets;
+    return;
 
   const int numSamples = buffer.getNumSamples();
   const int windowSize =
       (int)(0.005 * sampleRate); // 5ms window for better transient detail
   const float threshold = 0.02f; // Lowered threshold for better sensitivity
+  // Minimum 50ms between onsets (allow faster slices)
+  const int skip = std::max(1, (int)(0.05 * sampleRate));
+
+  // At most one onset per skip, so this is the only growth onsets needs
+  onsets.reserve((size_t)(numSamples / skip + 1));
 
   float lastEnergy = 0.0f;
 
   for (int i = 0; i < numSamples - windowSize; i += windowSize / 2) {
-    float energy = 0.0f;
-    for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
-      auto *data = buffer.getReadPointer(channel, i);
-      for (int s = 0; s < windowSize; ++s)
-        energy += data[s] * data[s];
-    }
-
+    float energy = AnalysisKernels::sumSquares(buffer, i, windowSize);
     energy /= (windowSize * buffer.getNumChannels());
     energy = std::sqrt(energy);
 
     if (energy > threshold && energy > lastEnergy * 1.2f) {
       // Simple peak picking: find the actual local max within this window
       onsets.push_back(i);
-      int skip = (int)(0.05 * sampleRate); // Minimum 50ms between onsets (allow
-                                           // faster slices)
-      i += std::max(1, skip);
+      i += skip;
     }
 
     lastEnergy = energy;
   }
-
-  return onsets;
 }
 
-double AudioAnalysis::detectBPM(const juce::AudioBuffer<float> &buffer,
-                                double sampleRate) {
-  if (sampleRate <= 0 || buffer.getNumSamples() < 1024)
-    return 0.0;
+void AudioAnalysis::findOnsetsSpectralFlux(
+    const juce::AudioBuffer<float> &buffer, double sampleRate,
+    AnalysisWorkspace &workspace, std::vector<int> &onsets) {
+  SAMPLER_TRACE_SCOPE("findOnsetsSpectralFlux", buffer.getNumSamples());
+  onsets.clear();
 
-  // 1. Create Onset Detection Function (ODF)
-  const float hopSeconds = 0.005f; // 5ms hops for better transient resolution
-  const int hopSize = (int)(hopSeconds * sampleRate);
+  const int fftSize = 1 << fluxFftOrder;
+  const int hop = fluxHopSize;
   const int numSamples = buffer.getNumSamples();
-  std::vector<float> odf;
-  float lastEnergy = 0.0f;
+  const int numChannels = buffer.getNumChannels();
+  if (sampleRate <= 0 || numChannels == 0 || numSamples < fftSize)
+    return;
+
+  const int numFrames = 1 + (numSamples - fftSize) / hop;
+  const int numBins = fftSize / 2 + 1;
+
+  // Kick, body, presence and air bands, so a hi-hat under a kick still
+  // produces flux in its own band
+  const float bandStartHz[numFluxBands] = {30.0f, 200.0f, 1000.0f, 5000.0f};
+  int bandEdges[numFluxBands + 1];
+  for (int b = 0; b < numFluxBands; ++b)
+    bandEdges[b] = juce::jlimit(
+        1, numBins - 1,
+        (int)std::round(bandStartHz[b] * (float)fftSize / (float)sampleRate));
+  bandEdges[numFluxBands] = numBins;
+
+  auto &bandFlux = workspace.bandFlux;
+  bandFlux.assign((size_t)numFrames * numFluxBands, 0.0f);
+
+  // 1. STFT and per-band half-wave rectified log-magnitude flux. Frames are
+  // split into chunks; each chunk recomputes the frame before it so chunks
+  // are independent.
+  const float gamma = 100.0f; // Log compression
+  const float channelGain = 1.0f / (float)numChannels;
+
+  auto logSpectrum = [&](int frame, AnalysisWorkspace::FluxScratch &scratch,
+                         std::vector<float> &dest) {
+    float *fftData = scratch.fftData.data();
+    const int start = frame * hop;
+
+    AnalysisKernels::downmix(buffer, start, fftSize, channelGain, fftData);
+    juce::FloatVectorOperations::multiply(fftData, workspace.fluxWindow.data(),
+                                          fftSize);
+
+    scratch.fft->performFrequencyOnlyForwardTransform(fftData, true);
+
+    for (int k = 0; k < numBins; ++k)
+      dest[(size_t)k] = std::log1p(gamma * fftData[k]);
+  };
 
-  for (int i = 0; i < numSamples - hopSize; i += hopSize) {
-    float energy = 0.0f;
-    for (int c = 0; c < buffer.getNumChannels(); ++c) {
-      auto *data = buffer.getReadPointer(c, i);
-      for (int s = 0; s < hopSize; ++s)
-        energy += data[s] * data[s];
+  const int framesPerChunk = 256;
+  const int numChunks = (numFrames + framesPerChunk - 1) / framesPerChunk;
+
+  parallelFor(numChunks, [&](int chunk, int worker) {
+    auto &scratch = workspace.fluxScratch[(size_t)worker];
+    const int first = chunk * framesPerChunk;
+    const int last = std::min(numFrames, first + framesPerChunk);
+
+    if (first > 0)
+      logSpectrum(first - 1, scratch, scratch.previous);
+    else
+      std::fill(scratch.previous.begin(), scratch.previous.end(), 0.0f);
+
+    for (int t = first; t < last; ++t) {
+      logSpectrum(t, scratch, scratch.current);
+
+      float *flux = bandFlux.data() + (size_t)t * numFluxBands;
+      for (int b = 0; b < numFluxBands; ++b) {
+        float sum = 0.0f;
+        for (int k = bandEdges[b]; k < bandEdges[b + 1]; ++k)
+          sum += std::max(0.0f, scratch.current[(size_t)k] -
+                                    scratch.previous[(size_t)k]);
+        flux[b] = sum / (float)(bandEdges[b + 1] - bandEdges[b]);
+      }
+
+      std::swap(scratch.previous, scratch.current);
+    }
+  });
+
+  // 2. Normalise each band by its mean so quiet bands weigh as much as loud
+  // ones, then sum into a single detection function
+  float bandSum[numFluxBands] = {};
+  for (int t = 0; t < numFrames; ++t)
+    for (int b = 0; b < numFluxBands; ++b)
+      bandSum[b] += bandFlux[(size_t)t * numFluxBands + b];
+
+  auto &odf = workspace.fluxOdf;
+  odf.assign((size_t)numFrames, 0.0f);
+  float odfMax = 0.0f, odfMean = 0.0f, odfSquares = 0.0f;
+  for (int t = 0; t < numFrames; ++t) {
+    float sum = 0.0f;
+    for (int b = 0; b < numFluxBands; ++b)
+      if (bandSum[b] > 0.0f)
+        sum += bandFlux[(size_t)t * numFluxBands + b] * (float)numFrames /
+               bandSum[b];
+    odf[(size_t)t] = sum / numFluxBands;
+    odfMax = std::max(odfMax, odf[(size_t)t]);
+    odfMean += odf[(size_t)t];
+    odfSquares += odf[(size_t)t] * odf[(size_t)t];
+  }
+  odfMean /= (float)numFrames;
+  const float odfDeviation =
+      std::sqrt(std::max(0.0f, odfSquares / numFrames - odfMean * odfMean));
+
+  if (odfMax <= 0.0f)
+    return;
+
+  // 3. Adaptive threshold from a running median over +-100ms, then local
+  // maximum peak picking with a short refractory period
+  const int medianRadius =
+      std::max(1, (int)std::round(0.1 * sampleRate / hop));
+  const int minGapFrames =
+      std::max(1, (int)std::round(0.03 * sampleRate / hop));
+  const float thresholdScale = 1.5f;
+  const float thresholdOffset = 0.5f * odfDeviation;
+
+  auto &median = workspace.fluxMedian;
+  median.reset(odfMax);
+  for (int t = 0; t < std::min(medianRadius, numFrames); ++t)
+    median.add(odf[(size_t)t]);
+
+  int lastOnsetFrame = -minGapFrames;
+  for (int t = 0; t < numFrames; ++t) {
+    if (t + medianRadius < numFrames)
+      median.add(odf[(size_t)(t + medianRadius)]);
+    if (t - medianRadius - 1 >= 0)
+      median.remove(odf[(size_t)(t - medianRadius - 1)]);
+
+    const float value = odf[(size_t)t];
+    const float threshold =
+        thresholdScale * median.getMedian() + thresholdOffset;
+
+    bool isPeak = value > threshold;
+    const int neighbourhoodEnd = std::min(numFrames - 1, t + 2);
+    for (int n = std::max(0, t - 2); isPeak && n <= neighbourhoodEnd; ++n)
+      if (n != t && odf[(size_t)n] > value)
+        isPeak = false;
+
+    if (isPeak && t - lastOnsetFrame >= minGapFrames) {
+      // Flux peaks while the attack is still in the tail of the window;
+      // report slightly early so slices keep the start of the transient
+      onsets.push_back(std::max(0, t * hop + fftSize * 3 / 4 - hop / 2));
+      lastOnsetFrame = t;
     }
+  }
+}
+
+void AudioAnalysis::computeODF(const juce::AudioBuffer<float> &buffer,
+                               int hopSize, std::vector<float> &odf) {
+  const int numSamples = buffer.getNumSamples();
+  const int numFrames = hopSize > 0 ? (numSamples - 1) / hopSize : 0;
+  odf.resize((size_t)std::max(0, numFrames));
+
+  float lastEnergy = 0.0f;
+
+  for (int frame = 0; frame < numFrames; ++frame) {
+    const int i = frame * hopSize;
+    float energy = AnalysisKernels::sumSquares(buffer, i, hopSize);
     energy = std::sqrt(energy / (hopSize * buffer.getNumChannels()));
 
     float flux = std::max(0.0f, energy - lastEnergy);
-    odf.push_back(flux);
+    odf[(size_t)frame] = flux;
     lastEnergy = energy;
   }
+}
 
-  if (odf.size() < 20)
-    return 0.0;
+int AudioAnalysis::findTempoLag(const float *odf, int size,
+                                AnalysisWorkspace::LagScratch &scratch) {
+  if (size < 20)
+    return 0;
 
-  // 2. Autocorrelation on ODF
+  // Autocorrelation on ODF
   // Pulse range: 60 BPM (1s) to 220 BPM (~0.27s)
-  int minLag = (int)(0.27 / hopSeconds);
-  int maxLag = (int)(1.1 / hopSeconds);
-  maxLag = std::min((int)odf.size() - 2, maxLag);
+  const int minLag = minTempoLag;
+  const int maxLag = std::min(size - 2, maxTempoLag);
 
-  struct Peak {
-    int lag;
-    float value;
-  };
-  std::vector<Peak> allPeaks;
+  auto &allPeaks = scratch.peaks;
+  allPeaks.clear();
 
-  std::vector<float> acResult(maxLag + 1, 0.0f);
+  auto &acResult = scratch.acResult;
+  acResult.assign((size_t)maxLag + 1, 0.0f);
   for (int lag = minLag; lag <= maxLag; ++lag) {
-    float corr = 0.0f;
-    int count = 0;
-    for (int i = 0; i < (int)odf.size() - lag; ++i) {
-      corr += odf[i] * odf[i + lag];
-      count++;
-    }
+    const int count = size - lag;
     if (count > 0)
-      acResult[lag] = corr / (float)count;
+      acResult[lag] =
+          AnalysisKernels::dot(odf, odf + lag, count) / (float)count;
   }
 
   // Find all local maxima (peaks)
@@ -127,13 +348,15 @@ double AudioAnalysis::detectBPM(const juce::AudioBuffer<float> &buffer,
   }
 
   if (allPeaks.empty())
-    return 0.0;
+    return 0;
+
+  using Peak = AnalysisWorkspace::Peak;
 
   // Sort peaks by value
   std::sort(allPeaks.begin(), allPeaks.end(),
             [](const Peak &a, const Peak &b) { return a.value > b.value; });
 
-  // 3. Harmonic Check
+  // Harmonic Check
   // If the best peak is a 2/3 or 1/2 multiplier of a slightly weaker but
   // standard peak, prefer the standard one.
   int bestLag = allPeaks[0].lag;
@@ -158,25 +381,203 @@ double AudioAnalysis::detectBPM(const juce::AudioBuffer<float> &buffer,
     }
   }
 
-  double finalBpm = 60.0 / (bestLag * hopSeconds);
-  return std::round(finalBpm * 10.0) / 10.0;
+  return bestLag;
+}
+
+double AudioAnalysis::detectBPM(AnalysisWorkspace &workspace) {
+  SAMPLER_TRACE_SCOPE("detectBPM", workspace.odf.size());
+
+  // 1. Onset Detection Function (ODF) is already in the workspace
+  // 2. Autocorrelation and 3. Harmonic Check
+  return estimateTempo(workspace.odf.data(), (int)workspace.odf.size(),
+                       workspace);
+}
+
+double AudioAnalysis::estimateTempo(const float *odf, int numFrames,
+                                    AnalysisWorkspace &workspace) {
+  if (workspace.lagScratch.empty())
+    return 0.0;
+
+  int bestLag = findTempoLag(odf, numFrames, workspace.lagScratch[0]);
+  if (bestLag <= 0)
+    return 0.0;
+
+  double bpm = 60.0 / (bestLag * hopSeconds);
+  return std::round(bpm * 10.0) / 10.0;
+}
+
+void AudioAnalysis::detectTempoMap(AnalysisWorkspace &workspace, int hopSize,
+                                   double sampleRate,
+                                   AnalysisResults &results) {
+  SAMPLER_TRACE_SCOPE("detectTempoMap", workspace.odf.size());
+  results.beats.clear();
+  results.beatTempos.clear();
+
+  const auto &odf = workspace.odf;
+  const int numFrames = (int)odf.size();
+
+  const int globalLag =
+      findTempoLag(odf.data(), numFrames, workspace.lagScratch[0]);
+  if (globalLag <= 0)
+    return;
+
+  // 1. Local tempo per sliding window (6s windows, 1s apart), one window per
+  // task so long mixes spread across all cores
+  const int windowFrames = std::min(numFrames, tempoWindowFrames);
+  const int stepFrames = tempoWindowStepFrames;
+  const int numWindows = 1 + (numFrames - windowFrames) / stepFrames;
+
+  auto &windowLags = workspace.windowLags;
+  windowLags.assign((size_t)numWindows, 0.0);
+  parallelFor(numWindows, [&](int w, int worker) {
+    SAMPLER_TRACE_SCOPE("tempoWindow", windowFrames);
+    int lag = findTempoLag(odf.data() + w * stepFrames, windowFrames,
+                           workspace.lagScratch[(size_t)worker]);
+    double period = lag > 0 ? (double)lag : (double)globalLag;
+
+    // Keep every window in the same octave as the global estimate so the
+    // tracker follows drift instead of jumping between half/double time
+    while (period > globalLag * 1.5)
+      period *= 0.5;
+    while (period < globalLag / 1.5)
+      period *= 2.0;
+
+    windowLags[(size_t)w] = period;
+  });
+
+  // Median of three to reject single-window outliers
+  auto &smoothedLags = workspace.smoothedLags;
+  smoothedLags.assign(windowLags.begin(), windowLags.end());
+  for (int w = 1; w < numWindows - 1; ++w) {
+    double a = windowLags[(size_t)w - 1], b = windowLags[(size_t)w],
+           c = windowLags[(size_t)w + 1];
+    smoothedLags[(size_t)w] =
+        std::max(std::min(a, b), std::min(std::max(a, b), c));
+  }
+
+  // Interpolate window periods onto every ODF frame
+  auto &framePeriods = workspace.framePeriods;
+  framePeriods.resize((size_t)numFrames);
+  for (int t = 0; t < numFrames; ++t) {
+    double pos = (double)(t - windowFrames / 2) / (double)stepFrames;
+    pos = juce::jlimit(0.0, (double)(numWindows - 1), pos);
+    int w = std::min((int)pos, numWindows - 1);
+    int next = std::min(w + 1, numWindows - 1);
+    double frac = pos - w;
+    framePeriods[(size_t)t] = smoothedLags[(size_t)w] * (1.0 - frac) +
+                              smoothedLags[(size_t)next] * frac;
+  }
+
+  SAMPLER_TRACE_SCOPE("beatTracker", numFrames);
+
+  // 2. Dynamic-programming beat tracker (Ellis 2007): every frame scores its
+  // onset strength plus the best predecessor, penalising intervals that
+  // deviate from the local period on a log scale
+  float mean = std::accumulate(odf.begin(), odf.end(), 0.0f) / numFrames;
+  float variance = 0.0f;
+  for (float v : odf)
+    variance += (v - mean) * (v - mean);
+  float norm = std::sqrt(variance / numFrames);
+  if (norm <= 0.0f)
+    return;
+
+  const float tightness = 100.0f;
+  auto &score = workspace.score;
+  auto &backlink = workspace.backlink;
+  score.resize((size_t)numFrames);
+  backlink.assign((size_t)numFrames, -1);
+
+  for (int t = 0; t < numFrames; ++t) {
+    const double period = framePeriods[(size_t)t];
+    const int from = std::max(0, t - (int)std::round(2.0 * period));
+    const int to = t - (int)std::round(0.5 * period);
+
+    float best = 0.0f;
+    int bestPrev = -1;
+    for (int prev = from; prev <= to; ++prev) {
+      float deviation = (float)std::log((t - prev) / period);
+      float candidate = score[(size_t)prev] - tightness * deviation * deviation;
+      if (bestPrev < 0 || candidate > best) {
+        best = candidate;
+        bestPrev = prev;
+      }
+    }
+
+    score[(size_t)t] = odf[(size_t)t] / norm + (bestPrev >= 0 ? best : 0.0f);
+    backlink[(size_t)t] = bestPrev;
+  }
+
+  // Backtrack from the best-scoring frame within the final beat period
+  const int tailStart = std::max(
+      0, numFrames - (int)std::round(framePeriods[(size_t)numFrames - 1]));
+  int frame = (int)(std::max_element(score.begin() + tailStart, score.end()) -
+                    score.begin());
+
+  auto &beatFrames = workspace.beatFrames;
+  beatFrames.clear();
+  for (; frame >= 0; frame = backlink[(size_t)frame])
+    beatFrames.push_back(frame);
+  std::reverse(beatFrames.begin(), beatFrames.end());
+
+  // The chain always reaches back to the start of the file, so trim leading
+  // and trailing beats that land on silence
+  float beatEnergy = 0.0f;
+  for (int f : beatFrames)
+    beatEnergy += odf[(size_t)f] * odf[(size_t)f];
+  const float trimThreshold =
+      0.5f * std::sqrt(beatEnergy / (float)beatFrames.size());
+
+  while (!beatFrames.empty() && odf[(size_t)beatFrames.back()] < trimThreshold)
+    beatFrames.pop_back();
+  auto firstBeat =
+      std::find_if(beatFrames.begin(), beatFrames.end(),
+                   [&](int f) { return odf[(size_t)f] >= trimThreshold; });
+  beatFrames.erase(beatFrames.begin(), firstBeat);
+
+  if (beatFrames.size() < 2)
+    return;
+
+  // 3. Per-beat tempo curve from the tracked intervals, lightly smoothed
+  const int numBeats = (int)beatFrames.size();
+  results.beats.reserve((size_t)numBeats);
+  for (int f : beatFrames)
+    results.beats.push_back(f * hopSize);
+
+  auto &rawTempos = workspace.rawTempos;
+  rawTempos.resize((size_t)numBeats);
+  for (int b = 0; b < numBeats; ++b) {
+    int from = b < numBeats - 1 ? b : b - 1;
+    int interval =
+        results.beats[(size_t)from + 1] - results.beats[(size_t)from];
+    rawTempos[(size_t)b] = 60.0 * sampleRate / (double)std::max(1, interval);
+  }
+
+  results.beatTempos.resize((size_t)numBeats);
+  for (int b = 0; b < numBeats; ++b) {
+    int lo = std::max(0, b - 2), hi = std::min(numBeats - 1, b + 2);
+    double sum = 0.0;
+    for (int i = lo; i <= hi; ++i)
+      sum += rawTempos[(size_t)i];
+    results.beatTempos[(size_t)b] = sum / (hi - lo + 1);
+  }
 }
 
 double AudioAnalysis::detectFrequency(const juce::AudioBuffer<float> &buffer,
-                                      double sampleRate) {
+                                      double sampleRate,
+                                      AnalysisWorkspace &workspace) {
+  SAMPLER_TRACE_SCOPE("detectFrequency", buffer.getNumSamples());
   // Simplified Autocorrelation for Pitch Detection
-  const int maxSamples =
-      std::min(buffer.getNumSamples(), (int)(4096)); // Analyze first ~90ms
+  const int maxSamples = std::min(
+      buffer.getNumSamples(), pitchWindowSamples); // Analyze first ~90ms
   if (maxSamples < 512 || sampleRate <= 0)
     return 0.0;
 
-  std::vector<float> ac(maxSamples, 0.0f);
+  auto &ac = workspace.pitchAc;
+  ac.assign((size_t)maxSamples, 0.0f);
   auto *data = buffer.getReadPointer(0); // Use first channel
 
-  for (int lag = 0; lag < maxSamples; ++lag) {
-    for (int i = 0; i < maxSamples - lag; ++i)
-      ac[lag] += data[i] * data[i + lag];
-  }
+  for (int lag = 0; lag < maxSamples; ++lag)
+    ac[lag] = AnalysisKernels::dot(data, data + lag, maxSamples - lag);
 
   // Find first significant peak after the zero-lag peak
   int peakLag = 0;
@@ -203,3 +604,286 @@ double AudioAnalysis::detectFrequency(const juce::AudioBuffer<float> &buffer,
 
   return 0.0;
 }
+
+void AudioAnalysis::SliceFeatures::resize(int numSlices) {
+  const auto size = (size_t)juce::jmax(0, numSlices);
+  start.resize(size);
+  length.resize(size);
+  duration.resize(size);
+  pitch.resize(size);
+  rms.resize(size);
+  loudness.resize(size);
+  peak.resize(size);
+  centroid.resize(size);
+  fingerprint.resize(size * fingerprintSize);
+}
+
+void AudioAnalysis::SliceFeatures::copySlice(int slice,
+                                             const SliceFeatures &source,
+                                             int sourceSlice) {
+  const auto to = (size_t)slice, from = (size_t)sourceSlice;
+  start[to] = source.start[from];
+  length[to] = source.length[from];
+  duration[to] = source.duration[from];
+  pitch[to] = source.pitch[from];
+  rms[to] = source.rms[from];
+  loudness[to] = source.loudness[from];
+  peak[to] = source.peak[from];
+  centroid[to] = source.centroid[from];
+  std::copy_n(source.getFingerprint(sourceSlice), fingerprintSize,
+              fingerprint.data() + to * fingerprintSize);
+}
+
+void AudioAnalysis::computeSliceFeatures(const juce::AudioBuffer<float> &buffer,
+                                         double sampleRate,
+                                         const std::vector<int> &onsets,
+                                         SliceFeatures &features) {
+  computeSliceFeatures(buffer, sampleRate, onsets, getThreadWorkspace(),
+                       features);
+}
+
+void AudioAnalysis::computeSliceFeatures(const juce::AudioBuffer<float> &buffer,
+                                         double sampleRate,
+                                         const std::vector<int> &onsets,
+                                         AnalysisWorkspace &workspace,
+                                         SliceFeatures &features) {
+  SAMPLER_TRACE_SCOPE("computeSliceFeatures", (juce::int64)onsets.size());
+
+  const int numSamples = buffer.getNumSamples();
+  const int numSlices = (sampleRate > 0 && buffer.getNumChannels() > 0)
+                            ? (int)onsets.size()
+                            : 0;
+  features.resize(numSlices);
+  if (numSlices == 0)
+    return;
+
+  workspace.prepare(numSamples, sampleRate);
+
+  for (int i = 0; i < numSlices; ++i) {
+    const int start = juce::jlimit(0, numSamples, onsets[(size_t)i]);
+    const int end = i + 1 < numSlices
+                        ? juce::jlimit(start, numSamples, onsets[(size_t)i + 1])
+                        : numSamples;
+    features.start[(size_t)i] = start;
+    features.length[(size_t)i] = end - start;
+    features.duration[(size_t)i] = (float)((end - start) / sampleRate);
+  }
+
+  // Slices are independent and claimed dynamically, so long and short ones
+  // balance out across workers
+  parallelFor(numSlices, [&](int slice, int worker) {
+    computeSliceFeature(buffer, sampleRate, slice, workspace, worker,
+                        features);
+  });
+}
+
+void AudioAnalysis::computeSliceFeature(const juce::AudioBuffer<float> &buffer,
+                                        double sampleRate, int slice,
+                                        AnalysisWorkspace &workspace,
+                                        int worker, SliceFeatures &features) {
+  const auto index = (size_t)slice;
+  const int start = features.start[index];
+  const int length = features.length[index];
+  const int numChannels = buffer.getNumChannels();
+  const float channelGain = 1.0f / (float)numChannels;
+
+  features.pitch[index] = 0.0f;
+  features.rms[index] = 0.0f;
+  features.loudness[index] = loudnessFloor;
+  features.peak[index] = 0.0f;
+  features.centroid[index] = 0.0f;
+  float *fingerprint = features.fingerprint.data() + index * fingerprintSize;
+  std::fill(fingerprint, fingerprint + fingerprintSize, 0.0f);
+
+  if (length <= 0)
+    return;
+
+  // 1. Peak, RMS and K-weighted loudness. BS.1770 sums the channels' mean
+  // squares, with unit weight for front left and right.
+  Biquad shelfPrototype, highPassPrototype;
+  makeKWeighting(sampleRate, shelfPrototype, highPassPrototype);
+
+  double sumSquares = 0.0, weightedSquares = 0.0;
+  float peak = 0.0f;
+  for (int c = 0; c < numChannels; ++c) {
+    const float *data = buffer.getReadPointer(c, start);
+    const auto range = AnalysisKernels::findMinAndMax(data, length);
+    peak = std::max(peak, std::max(-range.getStart(), range.getEnd()));
+
+    auto shelf = shelfPrototype;
+    auto highPass = highPassPrototype;
+    for (int i = 0; i < length; ++i) {
+      const float weighted = highPass.process(shelf.process(data[i]));
+      sumSquares += data[i] * data[i];
+      weightedSquares += weighted * weighted;
+    }
+  }
+
+  features.peak[index] = peak;
+  features.rms[index] =
+      (float)std::sqrt(sumSquares / ((double)length * numChannels));
+  if (weightedSquares > 0.0)
+    features.loudness[index] =
+        std::max(loudnessFloor,
+                 (float)(-0.691 + 10.0 * std::log10(weightedSquares / length)));
+
+  auto &scratch = workspace.sliceScratch[(size_t)worker];
+
+  // 2. Pitch: autocorrelation of the downmixed attack, like detectFrequency
+  // but limited to 50Hz-2kHz and only trusted when the period is clear
+  const int pitchLength = std::min(length, slicePitchWindowSamples);
+  if (pitchLength >= 512) {
+    float *mono = scratch.mono.data();
+    AnalysisKernels::downmix(buffer, start, pitchLength, channelGain, mono);
+
+    const int minLag = std::max(2, (int)(sampleRate / 2000.0));
+    const int maxLag = std::min(pitchLength / 2, (int)(sampleRate / 50.0));
+    float *ac = scratch.pitchAc.data();
+
+    for (int lag = 0; lag <= maxLag + 1; ++lag)
+      ac[lag] = AnalysisKernels::dot(mono, mono + lag, pitchLength - lag);
+
+    int bestLag = 0;
+    for (int lag = minLag; lag <= maxLag; ++lag)
+      if (ac[lag] > ac[lag - 1] && ac[lag] >= ac[lag + 1] &&
+          (bestLag == 0 || ac[lag] > ac[bestLag]))
+        bestLag = lag;
+
+    if (bestLag > 0 && ac[0] > 0.0f && ac[bestLag] > 0.3f * ac[0]) {
+      // Parabolic interpolation around the peak for sub-sample accuracy
+      const float left = ac[bestLag - 1], centre = ac[bestLag],
+                  right = ac[bestLag + 1];
+      const float denominator = left - 2.0f * centre + right;
+      const float offset =
+          denominator != 0.0f ? 0.5f * (left - right) / denominator : 0.0f;
+      features.pitch[index] =
+          (float)(sampleRate / ((double)bestLag + juce::jlimit(-0.5f, 0.5f,
+                                                               offset)));
+    }
+  }
+
+  // 3. Spectral centroid of the summed magnitude spectrum and the mean
+  // log-mel energies for the fingerprint, over non-overlapping windows
+  // sharing the spectral flux FFT
+  const int fftSize = 1 << fluxFftOrder;
+  const int numBins = fftSize / 2 + 1;
+  auto &fluxScratch = workspace.fluxScratch[(size_t)worker];
+  float *fftData = fluxScratch.fftData.data();
+  float *spectrum = scratch.spectrum.data();
+  float *melSum = scratch.melSum.data();
+  std::fill(spectrum, spectrum + numBins, 0.0f);
+  std::fill(melSum, melSum + numMelBands, 0.0f);
+  int numFrames = 0;
+
+  for (int offset = 0; offset < length; offset += fftSize) {
+    const int frameLength = std::min(fftSize, length - offset);
+
+    // A short tail is mostly zero padding and would drag the mean log-mel
+    // energies down, so only keep one if it is all the slice has
+    if (frameLength < fftSize / 2 && offset > 0)
+      break;
+
+    std::fill(fftData, fftData + fftSize * 2, 0.0f);
+
+    AnalysisKernels::downmix(buffer, start + offset, frameLength, 1.0f,
+                             fftData);
+    juce::FloatVectorOperations::multiply(fftData, workspace.fluxWindow.data(),
+                                          frameLength);
+
+    fluxScratch.fft->performFrequencyOnlyForwardTransform(fftData, true);
+    juce::FloatVectorOperations::add(spectrum, fftData, numBins);
+
+    for (int band = 0; band < numMelBands; ++band) {
+      const float *weights =
+          workspace.melWeights.data() + workspace.melWeightOffset[(size_t)band];
+      const float *bins = fftData + workspace.melFirstBin[(size_t)band];
+      float energy = 0.0f;
+      for (int k = 0; k < workspace.melNumBins[(size_t)band]; ++k)
+        energy += weights[k] * bins[k] * bins[k];
+      melSum[band] += std::log(energy + 1.0e-10f);
+    }
+    ++numFrames;
+  }
+
+  // The DCT is linear, so the DCT of the mean log-mel spectrum is the mean
+  // of the per-frame MFCCs
+  for (int band = 0; band < numMelBands; ++band)
+    melSum[band] /= (float)numFrames;
+  for (int c = 0; c < fingerprintSize; ++c) {
+    const float *row = workspace.dctTable.data() + c * numMelBands;
+    float sum = 0.0f;
+    for (int band = 0; band < numMelBands; ++band)
+      sum += row[band] * melSum[band];
+    fingerprint[c] = sum;
+  }
+
+  double weightedSum = 0.0, magnitudeSum = 0.0;
+  const double binHz = sampleRate / fftSize;
+  for (int k = 1; k < numBins; ++k) {
+    weightedSum += k * binHz * spectrum[k];
+    magnitudeSum += spectrum[k];
+  }
+
+  if (magnitudeSum > 0.0)
+    features.centroid[index] = (float)(weightedSum / magnitudeSum);
+}
+
+void AudioAnalysis::runOnsetBenchmark(double lengthSeconds) {
+  constexpr double sampleRate = 44100.0;
+  const int numSamples = (int)(lengthSeconds * sampleRate);
+  const int beat = (int)(sampleRate * 0.5); // 120 BPM
+
+  // Kick on every beat and a hat on every off-beat, so four onsets a second
+  juce::AudioBuffer<float> buffer(2, numSamples);
+  juce::Random random(99);
+  for (int i = 0; i < numSamples; ++i) {
+    const int sinceKick = i % beat, sinceHat = (i + beat / 2) % beat;
+    const float kick =
+        std::sin(juce::MathConstants<float>::twoPi * 55.0f *
+                 (float)sinceKick / (float)sampleRate) *
+        std::exp(-(float)sinceKick / (float)(0.08 * sampleRate));
+    const float hat = (random.nextFloat() * 2.0f - 1.0f) * 0.3f *
+                      std::exp(-(float)sinceHat / (float)(0.01 * sampleRate));
+    buffer.setSample(0, i, 0.8f * kick + hat);
+    buffer.setSample(1, i, 0.8f * kick - hat);
+  }
+
+  std::cout << "Analysis of " << lengthSeconds << " s of stereo at "
+            << sampleRate << " Hz on "
+            << ParallelPool::getInstance().getNumWorkers() << " workers, "
+            << (int)(lengthSeconds * 4.0) << " onsets expected\n";
+
+  for (auto engine : {OnsetEngine::energy, OnsetEngine::spectralFlux}) {
+    Options options;
+    options.tempoMap = true;
+    options.onsetEngine = engine;
+
+    // The first run sizes the workspace; the second is the one timed
+    AnalysisWorkspace workspace;
+    AnalysisResults results;
+    analyze(buffer, sampleRate, options, workspace, results);
+
+    const double startMs = juce::Time::getMillisecondCounterHiRes();
+    analyze(buffer, sampleRate, options, workspace, results);
+    const double totalMs = juce::Time::getMillisecondCounterHiRes() - startMs;
+
+    // The onset stage alone
+    std::vector<int> onsets;
+    const double onsetStartMs = juce::Time::getMillisecondCounterHiRes();
+    if (engine == OnsetEngine::spectralFlux)
+      findOnsetsSpectralFlux(buffer, sampleRate, workspace, onsets);
+    else
+      findOnsets(buffer, sampleRate, onsets);
+    const double onsetMs =
+        juce::Time::getMillisecondCounterHiRes() - onsetStartMs;
+
+    std::cout << (engine == OnsetEngine::spectralFlux ? "spectral flux"
+                                                      : "energy       ")
+              << "  onsets " << juce::String(onsetMs, 1) << " ms ("
+              << juce::String(lengthSeconds * 1000.0 / onsetMs, 0)
+              << "x realtime), full analysis " << juce::String(totalMs, 1)
+              << " ms (" << juce::String(lengthSeconds * 1000.0 / totalMs, 0)
+              << "x realtime), " << results.onsets.size() << " onsets\n";
+  }
+  std::cout << std::flush;
+}
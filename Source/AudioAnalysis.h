@@ -1,24 +1,131 @@
 #pragma once
 
+#include "AnalysisWorkspace.h"
 #include <JuceHeader.h>
 #include <vector>
 
 class AudioAnalysis {
 public:
+  enum class OnsetEngine {
+    energy,      // Broadband RMS jump with a fixed threshold
+    spectralFlux // Multi-band spectral flux with an adaptive threshold
+  };
+
+  struct Options {
+    bool tempoMap = false; // Track drifting tempo over sliding windows
+    OnsetEngine onsetEngine = OnsetEngine::energy;
+  };
+
+  // MFCC coefficients c1..c16, averaged over each slice. c0 (overall level)
+  // is left out so the same sound at a different gain still matches.
+  static constexpr int fingerprintSize = 16;
+
+  // One column per feature, so sorting or mapping slices by any one of them
+  // walks contiguous memory. Slice i runs from onsets[i] to the next onset
+  // or the end of the buffer, the same regions exportSlices writes.
+  struct SliceFeatures {
+    std::vector<int> start;      // Samples
+    std::vector<int> length;     // Samples
+    std::vector<float> duration; // Seconds
+    std::vector<float> pitch;    // Hz, 0 when no clear period is found
+    std::vector<float> rms;      // Linear, over all channels
+    std::vector<float> loudness; // K-weighted and ungated, in LUFS
+    std::vector<float> peak;     // Linear absolute peak
+    std::vector<float> centroid; // Spectral centroid in Hz
+    std::vector<float> fingerprint; // fingerprintSize per slice, row-major
+
+    int size() const { return (int)start.size(); }
+    void copySlice(int slice, const SliceFeatures &source, int sourceSlice);
+    const float *getFingerprint(int slice) const {
+      return fingerprint.data() + (size_t)slice * fingerprintSize;
+    }
+    void resize(int numSlices);
+  };
+
   struct AnalysisResults {
     double bpm = 0.0;
     double frequency = 0.0;
     std::vector<int> onsets;
+    SliceFeatures slices;
+
+    // Tempo map, only filled when Options::tempoMap is set
+    std::vector<int> beats;         // Beat grid in samples
+    std::vector<double> beatTempos; // Local BPM at each beat
   };
 
+  // Convenience overloads, backed by a workspace kept per calling thread for
+  // the thread's lifetime; batch code should pass its own instead
   static AnalysisResults analyze(const juce::AudioBuffer<float> &buffer,
                                  double sampleRate);
+  static AnalysisResults analyze(const juce::AudioBuffer<float> &buffer,
+                                 double sampleRate, const Options &options);
+
+  // Reuses both the workspace and the capacity already held by results, so
+  // repeated calls on similar-length buffers perform no heap allocations
+  static void analyze(const juce::AudioBuffer<float> &buffer,
+                      double sampleRate, const Options &options,
+                      AnalysisWorkspace &workspace, AnalysisResults &results);
+
+  // Fills features for the slices between onsets, one slice per ParallelPool
+  // task. Runs as the last stage of analyze(); call it again after onsets
+  // have been edited.
+  static void computeSliceFeatures(const juce::AudioBuffer<float> &buffer,
+                                   double sampleRate,
+                                   const std::vector<int> &onsets,
+                                   AnalysisWorkspace &workspace,
+                                   SliceFeatures &features);
+  static void computeSliceFeatures(const juce::AudioBuffer<float> &buffer,
+                                   double sampleRate,
+                                   const std::vector<int> &onsets,
+                                   SliceFeatures &features);
+
+  // Tempo of an energy-flux ODF sampled every hopSeconds (as produced by
+  // the live analyzer), or 0 if no periodicity is found
+  static double estimateTempo(const float *odf, int numFrames,
+                              AnalysisWorkspace &workspace);
+
+  // Times a full analysis of a synthetic stereo kick and hi-hat loop with
+  // each onset engine, printing the speed against realtime and the onsets
+  // found (--onset-bench)
+  static void runOnsetBenchmark(double lengthSeconds);
+
+  static constexpr float hopSeconds = 0.005f; // 5ms ODF hops
 
 private:
-  static double detectBPM(const juce::AudioBuffer<float> &buffer,
-                          double sampleRate);
+  friend class AnalysisWorkspace;
+
+  static constexpr int minTempoLag = (int)(0.27 / hopSeconds); // 220 BPM
+  static constexpr int maxTempoLag = (int)(1.1 / hopSeconds);  // ~55 BPM
+  static constexpr int tempoWindowFrames = (int)(6.0f / hopSeconds);
+  static constexpr int tempoWindowStepFrames = (int)(1.0f / hopSeconds);
+  static constexpr int pitchWindowSamples = 4096;
+  static constexpr int fluxFftOrder = 10; // 1024-point STFT
+  static constexpr int fluxHopSize = 256;
+  static constexpr int numFluxBands = 4;
+  static constexpr int slicePitchWindowSamples = 2048;
+  static constexpr int numMelBands = 26;
+  static constexpr float loudnessFloor = -100.0f; // LUFS reported for silence
+
+  static double detectBPM(AnalysisWorkspace &workspace);
+  static void detectTempoMap(AnalysisWorkspace &workspace, int hopSize,
+                             double sampleRate, AnalysisResults &results);
   static double detectFrequency(const juce::AudioBuffer<float> &buffer,
-                                double sampleRate);
-  static std::vector<int> findOnsets(const juce::AudioBuffer<float> &buffer,
-                                     double sampleRate);
+                                double sampleRate,
+                                AnalysisWorkspace &workspace);
+  static void findOnsets(const juce::AudioBuffer<float> &buffer,
+                         double sampleRate, std::vector<int> &onsets);
+  static void findOnsetsSpectralFlux(const juce::AudioBuffer<float> &buffer,
+                                     double sampleRate,
+                                     AnalysisWorkspace &workspace,
+                                     std::vector<int> &onsets);
+
+  static void computeSliceFeature(const juce::AudioBuffer<float> &buffer,
+                                  double sampleRate, int slice,
+                                  AnalysisWorkspace &workspace, int worker,
+                                  SliceFeatures &features);
+
+  static void computeODF(const juce::AudioBuffer<float> &buffer, int hopSize,
+                         std::vector<float> &odf);
+  static int findTempoLag(const float *odf, int size,
+                          AnalysisWorkspace::LagScratch &scratch);
 };
@@ -1,4 +1,8 @@
 #include "AudioEngine.h"
+#include "RealtimeChecks.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <cmath>
 
 AudioEngine::AudioEngine()
     : juce::AudioProcessor(
@@ -7,70 +11,567 @@ AudioEngine::AudioEngine()
               .withOutput("Output", juce::AudioChannelSet::stereo(), true)),
       juce::Thread("AnalysisThread") {
   formatManager.registerBasicFormats();
+  analysisOptions.tempoMap = true;
+
+  // Slices indexed in earlier sessions stay searchable straight from disk
+  auto libraryIndex = std::make_shared<SimilarityIndex>();
+  if (libraryIndex->open(getLibraryIndexFile()))
+    similarityIndex = std::move(libraryIndex);
 }
 
-AudioEngine::~AudioEngine() { stopThread(4000); }
+AudioEngine::~AudioEngine() {
+  stopTimer();
+  cancelPendingUpdate();
+  stopThread(4000);
+  saveSimilarityIndex();
+}
 
 void AudioEngine::prepareToPlay(double sampleRate, int samplesPerBlock) {
+  renderSampleRate = sampleRate;
   transportSource.prepareToPlay(samplesPerBlock, sampleRate);
+  renderProfiler.prepare(sampleRate, samplesPerBlock);
+  liveAnalyzer.prepare(sampleRate, samplesPerBlock);
 }
 
-void AudioEngine::releaseResources() { transportSource.releaseResources(); }
+void AudioEngine::releaseResources() {
+  liveAnalyzer.release();
+  transportSource.releaseResources();
+}
 
 void AudioEngine::processBlock(juce::AudioBuffer<float> &buffer,
                                juce::MidiBuffer &midiMessages) {
+  SAMPLER_RT_SCOPE();
+  RenderProfiler::ScopedBlock profileBlock(renderProfiler,
+                                           buffer.getNumSamples());
   juce::ScopedNoDenormals noDenormals;
   auto totalNumInputChannels = getTotalNumInputChannels();
   auto totalNumOutputChannels = getTotalNumOutputChannels();
 
-  for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
-    buffer.clear(i, 0, buffer.getNumSamples());
-
-  transportSource.getNextAudioBlock(juce::AudioSourceChannelInfo(buffer));
+  // Hand the input bus to the live analyzer, then silence it so it is
+  // never monitored straight back out
+  liveAnalyzer.pushBlock(buffer,
+                         juce::jmin(totalNumInputChannels,
+                                    buffer.getNumChannels()));
+  buffer.clear();
+
+  {
+    // The transport locks its callback lock every block; that only counts
+    // as a violation when a control thread is holding it
+    SAMPLER_RT_ALLOW_LOCK();
+    transportSource.getNextAudioBlock(juce::AudioSourceChannelInfo(buffer));
+  }
 
-  if (stopAtPosition > 0 &&
-      transportSource.getCurrentPosition() >= stopAtPosition) {
-    transportSource.stop();
+  // AudioTransportSource::stop() sleeps and posts a change message, so the
+  // audio thread only silences what lies past the slice end; timerCallback()
+  // stops the transport on the message thread
+  const double stopAt = stopAtPosition.load();
+  const double position = transportSource.getCurrentPosition();
+  if (stopAt > 0 && position >= stopAt) {
+    const int overshoot = juce::jmin(
+        buffer.getNumSamples(),
+        (int)std::ceil((position - stopAt) * renderSampleRate.load()));
+    buffer.clear(buffer.getNumSamples() - overshoot, overshoot);
+    sliceEnded = true;
     stopAtPosition = -1.0;
+  } else if (sliceEnded.load()) {
+    buffer.clear();
   }
 }
 
 void AudioEngine::loadFile(const juce::File &file) {
+  loadFiles(juce::Array<juce::File>(file));
+}
+
+void AudioEngine::loadFiles(const juce::Array<juce::File> &files) {
+  if (files.isEmpty())
+    return;
+
+  {
+    const juce::ScopedLock sl(workLock);
+    pendingFiles.addArray(files);
+    pendingAnalysisOptions = analysisOptions;
+  }
+  startWorker();
+}
+
+bool AudioEngine::selectSample(int index) {
+  if (index == currentSample && getNumLoadedSamples() > 0)
+    return true;
+
+  // Never decodes here, on the message thread; see below
+  SamplePool::Sample sample;
+  if (!samplePool.acquire(index, sample, false))
+    return false;
+
+  // Keep any onset edits made to the sample being switched away from, or
+  // made to this one while its audio was still on the way. Unedited results
+  // are left alone: the worker may have stored newer ones meanwhile.
+  if (currentSample >= 0 && analysisEdited)
+    samplePool.setAnalysis(currentSample, analysisResults);
+  analysisEdited = false;
+
   transportSource.stop();
   transportSource.setSource(nullptr);
-  readerSource.reset();
+  playbackSource.reset();
+  stopAtPosition = -1.0;
+
+  // Play straight from the pooled buffer; holding the shared_ptr keeps the
+  // pool from evicting it while it is current
+  currentAudio = std::move(sample.audio);
+  currentPacked = std::move(sample.packed);
+  currentPeaks = std::move(sample.peaks);
+  fileSampleRate = sample.sampleRate;
+  if (index != currentSample) {
+    analysisResults = std::move(sample.analysis);
+    pendingSliceStart = -1;
+  }
+  currentSample = index;
+
+  if (currentPacked != nullptr) {
+    playbackSource = std::make_unique<PackedAudioSource>(currentPacked);
+  } else if (currentAudio != nullptr) {
+    playbackSource =
+        std::make_unique<juce::MemoryAudioSource>(*currentAudio, false);
+  } else {
+    // Evicted. Decoding a long file takes seconds, so the worker does it
+    // while the peaks and slices show, and handleAsyncUpdate() selects the
+    // sample again once its audio is back in the pool.
+    {
+      const juce::ScopedLock sl(workLock);
+      pendingRestoreSample = index;
+    }
+    startWorker();
+  }
+
+  if (playbackSource != nullptr)
+    transportSource.setSource(playbackSource.get(), 0, nullptr,
+                              fileSampleRate);
+
+  sendChangeMessage();
+  return true;
+}
 
-  if (auto *reader = formatManager.createReaderFor(file)) {
-    fileSampleRate = reader->sampleRate;
-    readerSource =
-        std::make_unique<juce::AudioFormatReaderSource>(reader, true);
-    transportSource.setSource(readerSource.get(), 0, nullptr, fileSampleRate);
-    thumbnail.setSource(new juce::FileInputSource(file));
+void AudioEngine::stopRecording() {
+  if (!liveAnalyzer.isRecording())
+    return;
+
+  auto audio = std::make_shared<juce::AudioBuffer<float>>();
+  std::vector<int> liveOnsets;
+  liveAnalyzer.stopRecording(*audio, liveOnsets);
+
+  if (audio->getNumSamples() == 0)
+    return;
 
-    // Read into buffer for analysis
-    loadedBuffer.setSize((int)reader->numChannels,
-                         (int)reader->lengthInSamples);
-    reader->read(&loadedBuffer, 0, (int)reader->lengthInSamples, 0, true, true);
+  // Slice with the onsets found while recording straight away; the full
+  // analysis refines them in the background
+  AudioAnalysis::AnalysisResults liveResults;
+  liveResults.onsets = std::move(liveOnsets);
+  liveResults.bpm = liveAnalyzer.getCurrentBpm();
 
+  loadBuffer("Recording " + juce::String(++numRecordings), std::move(audio),
+             liveAnalyzer.getSampleRate(), liveResults);
+}
+
+void AudioEngine::loadBuffer(const juce::String &name,
+                             std::shared_ptr<juce::AudioBuffer<float>> audio,
+                             double sampleRate,
+                             const AudioAnalysis::AnalysisResults &initial) {
+  auto peaks = std::make_shared<WaveformPeaks>();
+  peaks->build(*audio, sampleRate);
+
+  const int index = samplePool.addBuffer(name, std::move(audio), sampleRate,
+                                         std::move(peaks), initial);
+
+  if (selectSample(index))
     runAnalysis();
-  }
 }
 
 void AudioEngine::runAnalysis() {
-  if (isThreadRunning())
-    stopThread(2000);
+  if (getNumLoadedSamples() == 0)
+    return;
+
+  {
+    const juce::ScopedLock sl(workLock);
+    pendingAnalysisSample = currentSample;
+    pendingAnalysisAudio = currentAudio;
+    pendingAnalysisPacked = currentPacked;
+    pendingAnalysisSampleRate = fileSampleRate;
+    pendingAnalysisOptions = analysisOptions;
+  }
+  startWorker();
+}
+
+void AudioEngine::startWorker() {
+  bool needsStart;
+  {
+    const juce::ScopedLock sl(workLock);
+    needsStart = !workerBusy;
+    workerBusy = true;
+  }
 
-  startThread();
+  // A worker that has just drained the queue may still be on its way out
+  if (needsStart) {
+    waitForThreadToExit(-1);
+    startThread();
+  }
 }
 
 void AudioEngine::run() {
-  if (loadedBuffer.getNumSamples() > 0) {
-    analysisResults = AudioAnalysis::analyze(loadedBuffer, fileSampleRate);
-    sendChangeMessage();
+  while (!threadShouldExit()) {
+    juce::Array<juce::File> files;
+    int analysisSample;
+    std::shared_ptr<juce::AudioBuffer<float>> analysisAudio;
+    std::shared_ptr<const PackedAudioBuffer> analysisPacked;
+    double analysisSampleRate;
+    AudioAnalysis::Options options;
+    int restoreSample;
+    {
+      const juce::ScopedLock sl(workLock);
+      files.swapWith(pendingFiles);
+      analysisSample = std::exchange(pendingAnalysisSample, -1);
+      analysisAudio = std::move(pendingAnalysisAudio);
+      analysisPacked = std::move(pendingAnalysisPacked);
+      analysisSampleRate = pendingAnalysisSampleRate;
+      options = pendingAnalysisOptions;
+      restoreSample = std::exchange(pendingRestoreSample, -1);
+
+      if (files.isEmpty() && analysisAudio == nullptr &&
+          analysisPacked == nullptr && restoreSample < 0) {
+        workerBusy = false;
+        return;
+      }
+    }
+
+    bool reanalysed = false;
+    if (restoreSample >= 0) {
+      // Decoding into the pool is all that is needed here; the message
+      // thread picks the audio up from there
+      SamplePool::Sample restored;
+      if (samplePool.acquire(restoreSample, restored)) {
+        // A session saved before its file changed length describes other
+        // audio, so its peaks and slices are made again from what was
+        // decoded. Done before the message thread selects the sample.
+        const int length = restored.audio != nullptr
+                               ? restored.audio->getNumSamples()
+                               : restored.packed->getNumSamples();
+        if (restored.peaks == nullptr ||
+            restored.peaks->getNumSamples() != length) {
+          analyseOnWorker(restoreSample, restored.audio, restored.packed,
+                          restored.sampleRate, options, true);
+          reanalysed = true;
+        }
+        restoredSample = restoreSample;
+        triggerAsyncUpdate();
+      }
+    }
+
+    if (!files.isEmpty()) {
+      const int first = samplePool.loadFiles(
+          files, options, [this] { return threadShouldExit(); });
+      if (first >= 0) {
+        loadedSelection = first;
+        triggerAsyncUpdate();
+      }
+    }
+
+    if (analysisAudio != nullptr || analysisPacked != nullptr) {
+      analyseOnWorker(analysisSample, analysisAudio, analysisPacked,
+                      analysisSampleRate, options, false);
+      reanalysed = true;
+    }
+
+    // Slices changed either way; done last so the UI updates first. A
+    // restore alone brings back slices the index already has.
+    if ((!files.isEmpty() || reanalysed) && !threadShouldExit())
+      updateSimilarityIndex();
+  }
+
+  const juce::ScopedLock sl(workLock);
+  workerBusy = false;
+}
+
+void AudioEngine::analyseOnWorker(
+    int sample, const std::shared_ptr<juce::AudioBuffer<float>> &audio,
+    const std::shared_ptr<const PackedAudioBuffer> &packed, double sampleRate,
+    const AudioAnalysis::Options &options, bool rebuildPeaks) {
+  // Analysis needs the whole signal at once; packed audio is expanded only
+  // for as long as the analysis runs
+  if (packed != nullptr) {
+    unpackedAudio.setSize(packed->getNumChannels(), packed->getNumSamples());
+    packed->read(unpackedAudio, 0, 0, packed->getNumSamples());
+  }
+  const auto &buffer = packed != nullptr ? unpackedAudio : *audio;
+
+  if (rebuildPeaks) {
+    auto peaks = std::make_shared<WaveformPeaks>();
+    peaks->build(buffer, sampleRate);
+    samplePool.setPeaks(sample, std::move(peaks));
+  }
+  AudioAnalysis::analyze(buffer, sampleRate, options, analysisWorkspace,
+                         workerResults);
+  unpackedAudio.setSize(0, 0);
+
+  samplePool.setAnalysis(sample, workerResults);
+  analysedSample = sample;
+  triggerAsyncUpdate();
+}
+
+void AudioEngine::handleAsyncUpdate() {
+  const int selection = loadedSelection.exchange(-1);
+  if (selection >= 0)
+    selectSample(selection);
+
+  // Before the restore below, so slices made again for a restored sample
+  // are not overwritten by the ones it was shown with
+  const int analysed = analysedSample.exchange(-1);
+  if (analysed >= 0 && analysed == currentSample) {
+    analysisResults = samplePool.getAnalysis(analysed);
+    analysisEdited = false;
+  }
+
+  // Only if nothing else was selected while it decoded
+  const int restored = restoredSample.exchange(-1);
+  if (restored >= 0 && restored == currentSample && selectSample(restored) &&
+      getNumLoadedSamples() > 0 && pendingSliceStart >= 0)
+    playSliceStartingAt(std::exchange(pendingSliceStart, -1));
+
+  sendChangeMessage();
+}
+
+juce::File AudioEngine::getDefaultSessionFile() {
+  return juce::File::getSpecialLocation(
+             juce::File::userApplicationDataDirectory)
+      .getChildFile("Sampler Pro")
+      .getChildFile("Session.bin");
+}
+
+bool AudioEngine::saveSession(const juce::File &file) {
+  // Restored peaks may still be mapped from this very file, which cannot be
+  // replaced while mapped on every platform; copy them out first, as
+  // saveSimilarityIndex() lets go of the library index before saving
+  samplePool.copyViewedPeaks();
+  if (currentPeaks != nullptr && currentPeaks->isView()) {
+    auto owned = std::make_shared<WaveformPeaks>();
+    owned->copyFrom(*currentPeaks);
+    currentPeaks = std::move(owned);
+  }
+
+  SessionFile::Contents session;
+  return makeSession(session) && SessionFile::save(session, file);
+}
+
+bool AudioEngine::openSession(const juce::File &file) {
+  SessionFile::Contents session;
+  if (!SessionFile::open(file, session) || !session.source.existsAsFile())
+    return false;
+
+  restoreSession(session);
+  return true;
+}
+
+void AudioEngine::getStateInformation(juce::MemoryBlock &destData) {
+  SessionFile::Contents session;
+  if (!makeSession(session))
+    return;
+
+  juce::MemoryOutputStream out(destData, false);
+  SessionFile::write(session, out);
+}
+
+void AudioEngine::setStateInformation(const void *data, int sizeInBytes) {
+  if (data == nullptr || sizeInBytes <= 0)
+    return;
+
+  // The restored peaks point into this copy and keep it alive
+  auto block = std::make_shared<juce::MemoryBlock>(data, (size_t)sizeInBytes);
+  SessionFile::Contents session;
+  if (SessionFile::read(block->getData(), block->getSize(), block, session) &&
+      session.source.existsAsFile())
+    restoreSession(session);
+}
+
+bool AudioEngine::makeSession(SessionFile::Contents &session) const {
+  // Recordings have no file to come back to
+  const auto file = samplePool.getFile(currentSample);
+  if (file == juce::File() || currentPeaks == nullptr)
+    return false;
+
+  session.source = file;
+  session.sampleRate = fileSampleRate;
+  session.zoom = viewZoom;
+  session.analysis = analysisResults;
+  session.peaks = currentPeaks;
+  return true;
+}
+
+void AudioEngine::restoreSession(const SessionFile::Contents &session) {
+  // The session's onsets win over whatever the pool had for the file
+  // unless the file has changed length since, which makes them another
+  // audio's; a newly added file is checked once the worker decodes it
+  int index = samplePool.indexOf(session.source);
+  if (index < 0 || samplePool.hasFailed(index)) {
+    index = samplePool.addFile(session.source, session.sampleRate,
+                               session.peaks, session.analysis);
+  } else {
+    SamplePool::Sample pooled;
+    if (samplePool.acquire(index, pooled, false) && pooled.peaks != nullptr &&
+        session.peaks != nullptr &&
+        pooled.peaks->getNumSamples() == session.peaks->getNumSamples())
+      samplePool.setAnalysis(index, session.analysis);
+  }
+  viewZoom = session.zoom;
+
+  if (index == currentSample) {
+    analysisResults = samplePool.getAnalysis(index);
+    analysisEdited = false;
+  }
+
+  // Shows the saved peaks and slices straight away; evicted audio follows
+  // from the worker
+  selectSample(index);
+  sendChangeMessage();
+}
+
+juce::File AudioEngine::getLibraryIndexFile() {
+  return juce::File::getSpecialLocation(
+             juce::File::userApplicationDataDirectory)
+      .getChildFile("Sampler Pro")
+      .getChildFile("SliceIndex.bin");
+}
+
+std::shared_ptr<const SimilarityIndex> AudioEngine::getSimilarityIndex() const {
+  const juce::ScopedLock sl(indexLock);
+  return similarityIndex;
+}
+
+void AudioEngine::updateSimilarityIndex() {
+  auto index = std::make_shared<SimilarityIndex>();
+
+  // Pooled samples with their latest slices; recordings have no file to
+  // come back to, so they are left out
+  juce::StringArray pooledPaths;
+  int numPooledSlices = 0;
+  for (int i = 0; i < samplePool.getNumSamples(); ++i) {
+    const auto file = samplePool.getFile(i);
+    if (file == juce::File())
+      continue;
+
+    const auto slices = samplePool.getAnalysis(i).slices;
+    pooledPaths.add(file.getFullPathName());
+    index->add(index->addSource(file.getFullPathName()), slices);
+    numPooledSlices += slices.size();
+  }
+
+  // Everything indexed before that is not pooled right now is carried over
+  // in its list, so only the pooled slices are assigned. The quantizer is
+  // trained again, over the whole library, once it has doubled since.
+  auto previous = getSimilarityIndex();
+  if (previous != nullptr && previous->getNumLists() > 0 &&
+      previous->getNumItems() + numPooledSlices <=
+          2 * previous->getNumTrainedItems()) {
+    index->build(*previous);
+  } else {
+    if (previous != nullptr) {
+      std::vector<int> sourceMap((size_t)previous->getNumSources(), -1);
+      for (int source = 0; source < previous->getNumSources(); ++source)
+        if (!pooledPaths.contains(previous->getSourceName(source)))
+          sourceMap[(size_t)source] =
+              index->addSource(previous->getSourceName(source));
+
+      float fingerprint[SimilarityIndex::dimensions];
+      for (int i = 0; i < previous->getNumItems(); ++i) {
+        const auto &item = previous->getItem(i);
+        if (sourceMap[(size_t)item.source] < 0)
+          continue;
+        previous->getFingerprint(i, fingerprint);
+        index->add(sourceMap[(size_t)item.source], item.start, item.length,
+                   fingerprint);
+      }
+    }
+    index->build();
+  }
+
+  const juce::ScopedLock sl(indexLock);
+  similarityIndex = index;
+  similarityIndexChanged = true;
+}
+
+void AudioEngine::saveSimilarityIndex() {
+  std::shared_ptr<const SimilarityIndex> index;
+  {
+    const juce::ScopedLock sl(indexLock);
+    if (!std::exchange(similarityIndexChanged, false))
+      return;
+    index = similarityIndex;
+  }
+
+  // Only ever a built index, never the one that may be mapped from this
+  // very file, so nothing still holds the file by the time it is replaced
+  auto indexFile = getLibraryIndexFile();
+  indexFile.getParentDirectory().createDirectory();
+  index->save(indexFile);
+}
+
+std::vector<AudioEngine::SimilarSlice>
+AudioEngine::findSimilarSlices(int sliceIndex, int maxResults) {
+  std::vector<SimilarSlice> similar;
+  auto index = getSimilarityIndex();
+  if (index == nullptr || getNumLoadedSamples() == 0 || sliceIndex < 0 ||
+      sliceIndex >= (int)analysisResults.onsets.size())
+    return similar;
+
+  refreshSliceFeatures();
+
+  const auto currentPath = samplePool.getFile(currentSample).getFullPathName();
+  const int start = analysisResults.slices.start[(size_t)sliceIndex];
+
+  std::vector<SimilarityIndex::Match> matches;
+  index->search(analysisResults.slices.getFingerprint(sliceIndex),
+                maxResults + 1, matches);
+
+  for (auto &match : matches) {
+    const auto &item = index->getItem(match.item);
+    const auto &path = index->getSourceName(item.source);
+    if (path == currentPath && item.start == start)
+      continue; // The query slice itself
+
+    if ((int)similar.size() < maxResults)
+      similar.push_back({juce::File(path), item.start, item.length,
+                         match.distance});
   }
+
+  return similar;
 }
 
-void AudioEngine::play() { transportSource.start(); }
+bool AudioEngine::jumpToSlice(const juce::File &file, int start) {
+  const int index = samplePool.indexOf(file);
+  if (index < 0) {
+    loadFile(file);
+    return false;
+  }
+
+  if (!selectSample(index))
+    return false;
+
+  // Evicted audio is still on its way; handleAsyncUpdate() plays it then
+  if (getNumLoadedSamples() > 0)
+    playSliceStartingAt(start);
+  else
+    pendingSliceStart = start;
+  return true;
+}
+
+void AudioEngine::playSliceStartingAt(int start) {
+  const auto &onsets = analysisResults.onsets;
+  const auto found = std::find(onsets.begin(), onsets.end(), start);
+  if (found != onsets.end())
+    playSlice((int)(found - onsets.begin()));
+}
+
+void AudioEngine::play() {
+  sliceEnded = false;
+  transportSource.start();
+}
 
 void AudioEngine::stop() { transportSource.stop(); }
 
@@ -85,25 +586,89 @@ void AudioEngine::playSlice(int sliceIndex) {
       stopAtPosition =
           (double)analysisResults.onsets[sliceIndex + 1] / fileSampleRate;
     } else {
-      stopAtPosition = (double)loadedBuffer.getNumSamples() / fileSampleRate;
+      stopAtPosition = (double)getNumLoadedSamples() / fileSampleRate;
     }
 
     transportSource.setPosition(startTime);
+    sliceEnded = false;
     transportSource.start();
+    startTimerHz(30);
+  }
+}
+
+void AudioEngine::timerCallback() {
+  // Read before sliceEnded, which the audio thread sets first
+  const bool slicePlaying = stopAtPosition.load() > 0;
+  if (sliceEnded.load() && transportSource.isPlaying())
+    transportSource.stop();
+  if (!slicePlaying)
+    stopTimer();
+}
+
+void AudioEngine::readLoadedSamples(juce::AudioBuffer<float> &destination,
+                                    int start, int numSamples) const {
+  destination.setSize(getNumLoadedChannels(), numSamples, false, false, true);
+
+  if (currentPacked != nullptr) {
+    currentPacked->read(destination, 0, start, numSamples);
+  } else if (currentAudio != nullptr) {
+    for (int channel = 0; channel < destination.getNumChannels(); ++channel)
+      destination.copyFrom(channel, 0, *currentAudio, channel, start,
+                           numSamples);
+  }
+}
+
+void AudioEngine::refreshSliceFeatures() {
+  // Markers may have been dragged since the analysis ran
+  auto &slices = analysisResults.slices;
+  if (currentAudio != nullptr) {
+    AudioAnalysis::computeSliceFeatures(*currentAudio, fileSampleRate,
+                                        analysisResults.onsets, slices);
+    return;
+  }
+
+  // Packed audio is expanded one slice at a time rather than as a whole
+  const auto &onsets = analysisResults.onsets;
+  const int total = getNumLoadedSamples();
+  const std::vector<int> sliceOrigin{0};
+  juce::AudioBuffer<float> sliceAudio;
+  AudioAnalysis::SliceFeatures single;
+
+  slices.resize((int)onsets.size());
+  for (int i = 0; i < (int)onsets.size(); ++i) {
+    const int start = juce::jlimit(0, total, onsets[(size_t)i]);
+    const int end = i + 1 < (int)onsets.size()
+                        ? juce::jlimit(start, total, onsets[(size_t)i + 1])
+                        : total;
+
+    readLoadedSamples(sliceAudio, start, end - start);
+    AudioAnalysis::computeSliceFeatures(sliceAudio, fileSampleRate,
+                                        sliceOrigin, single);
+    slices.copySlice(i, single, 0);
+    slices.start[(size_t)i] = start;
   }
 }
 
 void AudioEngine::exportSlices(const juce::File &directory) {
-  if (loadedBuffer.getNumSamples() == 0 || analysisResults.onsets.empty())
+  if (getNumLoadedSamples() == 0 || analysisResults.onsets.empty())
     return;
 
+  refreshSliceFeatures();
+  directory.getChildFile("Slices.csv")
+      .replaceWithText(createSliceReport(analysisResults.slices));
+
   juce::WavAudioFormat wavFormat;
+  juce::AudioBuffer<float> chunk;
 
+  // Clamped like computeSliceFeatures(): dragged or restored onsets are
+  // not guaranteed to lie inside the audio
+  const int total = getNumLoadedSamples();
   for (size_t i = 0; i < analysisResults.onsets.size(); ++i) {
-    int startSample = analysisResults.onsets[i];
-    int endSample = (i + 1 < analysisResults.onsets.size())
-                        ? analysisResults.onsets[i + 1]
-                        : loadedBuffer.getNumSamples();
+    int startSample = juce::jlimit(0, total, analysisResults.onsets[i]);
+    int endSample =
+        (i + 1 < analysisResults.onsets.size())
+            ? juce::jlimit(startSample, total, analysisResults.onsets[i + 1])
+            : total;
 
     int numSamples = endSample - startSample;
     if (numSamples <= 0)
@@ -116,12 +681,38 @@ void AudioEngine::exportSlices(const juce::File &directory) {
     if (auto writer =
             std::unique_ptr<juce::AudioFormatWriter>(wavFormat.createWriterFor(
                 new juce::FileOutputStream(sliceFile), getSampleRate(),
-                loadedBuffer.getNumChannels(), 16, {}, 0))) {
-      writer->writeFromAudioSampleBuffer(loadedBuffer, startSample, numSamples);
+                getNumLoadedChannels(), 16, {}, 0))) {
+      // Converted in chunks so packed samples never expand all at once
+      for (int offset = 0; offset < numSamples; offset += exportChunkSamples) {
+        const int count = juce::jmin(exportChunkSamples, numSamples - offset);
+        readLoadedSamples(chunk, startSample + offset, count);
+        writer->writeFromAudioSampleBuffer(chunk, 0, count);
+      }
     }
   }
 }
 
+juce::String
+AudioEngine::createSliceReport(const AudioAnalysis::SliceFeatures &slices) {
+  juce::String report;
+  report << "slice,file,start,length,duration_s,pitch_hz,rms,loudness_lufs,"
+            "peak,centroid_hz\n";
+
+  for (int i = 0; i < slices.size(); ++i) {
+    const auto index = (size_t)i;
+    report << (i + 1) << ",Slice_" << (i + 1) << ".wav,"
+           << slices.start[index] << "," << slices.length[index] << ","
+           << juce::String(slices.duration[index], 4) << ","
+           << juce::String(slices.pitch[index], 2) << ","
+           << juce::String(slices.rms[index], 5) << ","
+           << juce::String(slices.loudness[index], 2) << ","
+           << juce::String(slices.peak[index], 5) << ","
+           << juce::String(slices.centroid[index], 1) << "\n";
+  }
+
+  return report;
+}
+
 void AudioEngine::exportMidi(const juce::File &file) {
   if (analysisResults.onsets.empty())
     return;
@@ -1,12 +1,22 @@
 #pragma once
 
 #include "AudioAnalysis.h"
+#include "LiveAnalyzer.h"
+#include "RenderProfiler.h"
+#include "SamplePool.h"
+#include "SessionFile.h"
+#include "SimilarityIndex.h"
+#include "WaveformPeaks.h"
 #include <JuceHeader.h>
+#include <atomic>
 #include <memory>
+#include <utility>
 
 class AudioEngine : public juce::AudioProcessor,
                     public juce::Thread,
-                    public juce::ChangeBroadcaster {
+                    public juce::ChangeBroadcaster,
+                    private juce::AsyncUpdater,
+                    private juce::Timer {
 public:
   AudioEngine();
   ~AudioEngine() override;
@@ -16,10 +26,50 @@ public:
   void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
 
   void loadFile(const juce::File &file);
+
+  // Loads a batch into the sample pool in the background; the first file
+  // becomes the current sample once the batch is done
+  void loadFiles(const juce::Array<juce::File> &files);
+  bool selectSample(int index);
+  int getCurrentSample() const { return currentSample; }
+  const SamplePool &getSamplePool() const { return samplePool; }
+  void setSampleMemoryBudget(juce::int64 bytes) {
+    samplePool.setMemoryBudget(bytes);
+  }
+  // Keep 16/24-bit files packed in memory; applies to the next files loaded
+  void setCompactStorage(bool shouldBeCompact) {
+    samplePool.setCompactStorage(shouldBeCompact);
+  }
+  bool isCompactStorage() const { return samplePool.isCompactStorage(); }
+
+  // Similarity search over every slice of every sample loaded so far,
+  // including earlier sessions (the library index is kept on disk)
+  struct SimilarSlice {
+    juce::File file;
+    int start = 0;
+    int length = 0;
+    float distance = 0.0f;
+  };
+  std::vector<SimilarSlice> findSimilarSlices(int sliceIndex, int maxResults);
+  // Selects the sample and plays the slice starting at start. Files that are
+  // not pooled are loaded instead, returning false.
+  bool jumpToSlice(const juce::File &file, int start);
   void play();
   void stop();
   void playSlice(int sliceIndex);
 
+  // Live input: the recording is loaded like a file as soon as it stops
+  void startRecording() { liveAnalyzer.startRecording(); }
+  void stopRecording();
+  // Pools audio that has no file behind it and selects it; it is analysed
+  // in the background like a loaded file
+  void loadBuffer(const juce::String &name,
+                  std::shared_ptr<juce::AudioBuffer<float>> audio,
+                  double sampleRate,
+                  const AudioAnalysis::AnalysisResults &initial = {});
+  bool isRecording() const { return liveAnalyzer.isRecording(); }
+  const LiveAnalyzer &getLiveAnalyzer() const { return liveAnalyzer; }
+
   bool isPlaying() const { return transportSource.isPlaying(); }
   double getCurrentPosition() const {
     return transportSource.getCurrentPosition();
@@ -28,18 +78,30 @@ public:
     return transportSource.getLengthInSeconds();
   }
 
-  juce::AudioThumbnail &getThumbnail() { return thumbnail; }
+  // Null until a sample is selected
+  std::shared_ptr<const WaveformPeaks> getPeaks() const { return currentPeaks; }
+  RenderProfiler &getRenderProfiler() { return renderProfiler; }
 
   const AudioAnalysis::AnalysisResults &getAnalysis() const {
     return analysisResults;
   }
   AudioAnalysis::AnalysisResults &getAnalysis() { return analysisResults; }
+  // Call after changing the onsets through getAnalysis(), so the edit is
+  // kept when another sample is selected
+  void markAnalysisEdited() { analysisEdited = true; }
   void runAnalysis();
+  void setAnalysisOptions(const AudioAnalysis::Options &newOptions) {
+    analysisOptions = newOptions;
+  }
+  const AudioAnalysis::Options &getAnalysisOptions() const {
+    return analysisOptions;
+  }
   double getFileSampleRate() const { return fileSampleRate; }
 
-  void run() override; // Thread run method
+  void run() override; // Thread run method: batch loads and re-analysis
   bool isProcessing() const { return threadShouldExit() || isThreadRunning(); }
 
+  // Writes every slice as a WAV plus Slices.csv with their features
   void exportSlices(const juce::File &directory);
   void exportMidi(const juce::File &file);
 
@@ -63,22 +125,103 @@ public:
   const juce::String getProgramName(int index) override { return {}; }
   void changeProgramName(int index, const juce::String &newName) override {}
 
-  void getStateInformation(juce::MemoryBlock &destData) override {}
-  void setStateInformation(const void *data, int sizeInBytes) override {}
+  // Sessions keep the current sample's file, edited onsets, tempo, slices,
+  // zoom and peaks. Reopening one shows the waveform and slices straight
+  // away and decodes the audio in the background. Plugin state uses the
+  // same format. Saving first lets go of peaks mapped from an earlier
+  // session, so callers must drop any they hold (getPeaks()) beforehand.
+  bool saveSession(const juce::File &file);
+  bool openSession(const juce::File &file);
+  static juce::File getDefaultSessionFile();
+  void setViewZoom(double newZoom) { viewZoom = newZoom; }
+  double getViewZoom() const { return viewZoom; }
+
+  void getStateInformation(juce::MemoryBlock &destData) override;
+  void setStateInformation(const void *data, int sizeInBytes) override;
 
 private:
+  static constexpr int exportChunkSamples = 65536;
+
+  static juce::String
+  createSliceReport(const AudioAnalysis::SliceFeatures &slices);
+
+  void handleAsyncUpdate() override;
+  void analyseOnWorker(int sample,
+                       const std::shared_ptr<juce::AudioBuffer<float>> &audio,
+                       const std::shared_ptr<const PackedAudioBuffer> &packed,
+                       double sampleRate,
+                       const AudioAnalysis::Options &options,
+                       bool rebuildPeaks);
+  void timerCallback() override; // Stops the transport once a slice has ended
+  void startWorker();
+  void updateSimilarityIndex(); // Worker thread, after new slices
+  void saveSimilarityIndex();   // Once, on shutdown, if it has changed
+  std::shared_ptr<const SimilarityIndex> getSimilarityIndex() const;
+  static juce::File getLibraryIndexFile();
+  bool makeSession(SessionFile::Contents &session) const;
+  void restoreSession(const SessionFile::Contents &session);
+  int getNumLoadedSamples() const {
+    return currentAudio != nullptr    ? currentAudio->getNumSamples()
+           : currentPacked != nullptr ? currentPacked->getNumSamples()
+                                      : 0;
+  }
+  int getNumLoadedChannels() const {
+    return currentAudio != nullptr    ? currentAudio->getNumChannels()
+           : currentPacked != nullptr ? currentPacked->getNumChannels()
+                                      : 0;
+  }
+  // Resizes destination and fills it from the current sample as float
+  void readLoadedSamples(juce::AudioBuffer<float> &destination, int start,
+                         int numSamples) const;
+  void refreshSliceFeatures();
+  void playSliceStartingAt(int start);
+
   juce::AudioFormatManager formatManager;
-  std::unique_ptr<juce::AudioFormatReaderSource> readerSource;
+  std::unique_ptr<juce::PositionableAudioSource> playbackSource;
   juce::AudioTransportSource transportSource;
 
-  juce::AudioThumbnailCache thumbnailCache{5};
-  juce::AudioThumbnail thumbnail{512, formatManager, thumbnailCache};
+  SamplePool samplePool{formatManager};
+  int currentSample = -1;
+  int numRecordings = 0;
+  std::shared_ptr<juce::AudioBuffer<float>> currentAudio;  // Float storage
+  std::shared_ptr<const PackedAudioBuffer> currentPacked; // Compact storage
+  std::shared_ptr<const WaveformPeaks> currentPeaks;
+
+  // Work queued for the background thread. Results come back through the
+  // pool and are applied on the message thread in handleAsyncUpdate().
+  juce::CriticalSection workLock;
+  juce::Array<juce::File> pendingFiles;
+  int pendingAnalysisSample = -1;
+  std::shared_ptr<juce::AudioBuffer<float>> pendingAnalysisAudio;
+  std::shared_ptr<const PackedAudioBuffer> pendingAnalysisPacked;
+  double pendingAnalysisSampleRate = 44100.0;
+  AudioAnalysis::Options pendingAnalysisOptions; // As of the latest request
+  int pendingRestoreSample = -1;
+  bool workerBusy = false;
+  std::atomic<int> loadedSelection{-1};
+  std::atomic<int> analysedSample{-1};
+  std::atomic<int> restoredSample{-1};
+  int pendingSliceStart = -1; // jumpToSlice() target awaiting its audio
+
+  juce::CriticalSection indexLock;
+  std::shared_ptr<const SimilarityIndex> similarityIndex;
+  bool similarityIndexChanged = false; // Since it was opened or saved
 
   AudioAnalysis::AnalysisResults analysisResults;
-  juce::AudioBuffer<float> loadedBuffer;
+  bool analysisEdited = false; // Differs from the pool's copy
+  AudioAnalysis::Options analysisOptions; // Message thread only
+  AnalysisWorkspace analysisWorkspace; // Reused by every run() on this thread
+  AudioAnalysis::AnalysisResults workerResults; // Capacity reused likewise
+  juce::AudioBuffer<float> unpackedAudio; // Packed audio expanded for analysis
   double targetBpm = 0.0;
   double fileSampleRate = 44100.0;
-  double stopAtPosition = -1.0;
+  double viewZoom = 1.0;
+  std::atomic<double> stopAtPosition{-1.0}; // Set from any thread
+  std::atomic<bool> sliceEnded{false};      // Output muted until stopped
+  std::atomic<double> renderSampleRate{44100.0};
+
+  RenderProfiler renderProfiler;
+  LiveAnalyzer liveAnalyzer;
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioEngine)
 };
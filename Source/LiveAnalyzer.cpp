@@ -0,0 +1,201 @@
+#include "LiveAnalyzer.h"
+#include "AudioAnalysis.h"
+#include <cmath>
+
+LiveAnalyzer::LiveAnalyzer() : juce::Thread("LiveAnalyzerThread") {}
+
+LiveAnalyzer::~LiveAnalyzer() { stopThread(2000); }
+
+void LiveAnalyzer::prepare(double newSampleRate, int samplesPerBlock) {
+  release();
+
+  sampleRate = newSampleRate > 0 ? newSampleRate : 44100.0;
+
+  // Enough headroom for several blocks or half a second, whichever is more
+  const int fifoSize = juce::nextPowerOfTwo(
+      juce::jmax(samplesPerBlock * 8, (int)(sampleRate * 0.5)));
+  fifo.setTotalSize(fifoSize);
+  fifo.reset();
+  ring.setSize(numChannels, fifoSize);
+  ring.clear();
+  droppedSamples = 0;
+
+  streamPosition = 0;
+  hopSize = juce::jmax(1, (int)(AudioAnalysis::hopSeconds * sampleRate));
+  hopFill = 0;
+  hopEnergy = 0.0f;
+  lastEnergy = 0.0f;
+  lastOnsetPosition = -1;
+  minOnsetGap = (int)(0.05 * sampleRate); // Same 50ms as findOnsets
+
+  const int historyFrames =
+      (int)(tempoHistorySeconds / AudioAnalysis::hopSeconds);
+  odfHistory.assign((size_t)historyFrames, 0.0f);
+  odfLinear.assign((size_t)historyFrames, 0.0f);
+  odfWrite = 0;
+  odfFrames = 0;
+  framesSinceTempo = 0;
+  workspace.prepare((int)(tempoHistorySeconds * sampleRate), sampleRate);
+
+  currentBpm = 0.0;
+  numOnsets = 0;
+  lastOnsetSample = -1;
+  consumedSamples = 0;
+
+  startThread();
+  active = true;
+}
+
+void LiveAnalyzer::release() {
+  active = false;
+  stopThread(2000);
+}
+
+void LiveAnalyzer::pushBlock(const juce::AudioBuffer<float> &buffer,
+                             int numInputChannels) {
+  const int numSamples = buffer.getNumSamples();
+  if (numInputChannels <= 0 || numSamples <= 0 || !active.load())
+    return;
+
+  int start1, size1, start2, size2;
+  fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+  if (size1 + size2 < numSamples)
+    droppedSamples += numSamples - (size1 + size2);
+
+  for (int channel = 0; channel < numChannels; ++channel) {
+    // Mono inputs feed both channels
+    const int source = juce::jmin(channel, numInputChannels - 1);
+    if (size1 > 0)
+      ring.copyFrom(channel, start1, buffer, source, 0, size1);
+    if (size2 > 0)
+      ring.copyFrom(channel, start2, buffer, source, size1, size2);
+  }
+
+  fifo.finishedWrite(size1 + size2);
+}
+
+void LiveAnalyzer::run() {
+  while (!threadShouldExit()) {
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+    if (size1 > 0)
+      processSamples(start1, size1);
+    if (size2 > 0)
+      processSamples(start2, size2);
+
+    fifo.finishedRead(size1 + size2);
+
+    if (size1 + size2 == 0)
+      wait(pollIntervalMs);
+  }
+}
+
+void LiveAnalyzer::processSamples(int ringStart, int numSamples) {
+  if (recording.load())
+    appendToRecording(ringStart, numSamples);
+
+  auto *left = ring.getReadPointer(0, ringStart);
+  auto *right = ring.getReadPointer(1, ringStart);
+
+  for (int i = 0; i < numSamples; ++i) {
+    hopEnergy += left[i] * left[i] + right[i] * right[i];
+    if (++hopFill < hopSize)
+      continue;
+
+    // Same energy flux and onset rule as the offline analysis
+    const juce::int64 hopStart = streamPosition + i + 1 - hopSize;
+    const float energy = std::sqrt(hopEnergy / (hopSize * numChannels));
+    const float flux = juce::jmax(0.0f, energy - lastEnergy);
+
+    if (energy > 0.02f && energy > lastEnergy * 1.2f &&
+        (lastOnsetPosition < 0 ||
+         hopStart - lastOnsetPosition >= minOnsetGap)) {
+      lastOnsetPosition = hopStart;
+      lastOnsetSample = hopStart;
+      ++numOnsets;
+
+      if (recording.load()) {
+        const juce::ScopedLock sl(recordLock);
+        if (recordStart >= 0 && hopStart >= recordStart)
+          recordOnsets.push_back((int)(hopStart - recordStart));
+      }
+    }
+
+    lastEnergy = energy;
+    hopEnergy = 0.0f;
+    hopFill = 0;
+
+    odfHistory[(size_t)odfWrite] = flux;
+    odfWrite = (odfWrite + 1) % (int)odfHistory.size();
+    odfFrames = juce::jmin(odfFrames + 1, (int)odfHistory.size());
+
+    // Re-estimate the tempo once a second over the last few seconds
+    if (++framesSinceTempo >= (int)(1.0 / AudioAnalysis::hopSeconds)) {
+      framesSinceTempo = 0;
+
+      const int historySize = (int)odfHistory.size();
+      const int first = (odfWrite - odfFrames + historySize) % historySize;
+      for (int f = 0; f < odfFrames; ++f)
+        odfLinear[(size_t)f] = odfHistory[(size_t)((first + f) % historySize)];
+
+      currentBpm =
+          AudioAnalysis::estimateTempo(odfLinear.data(), odfFrames, workspace);
+    }
+  }
+
+  streamPosition += numSamples;
+  consumedSamples = streamPosition;
+}
+
+void LiveAnalyzer::appendToRecording(int ringStart, int numSamples) {
+  const juce::ScopedLock sl(recordLock);
+
+  if (recordStart < 0)
+    recordStart = streamPosition;
+
+  // Grow geometrically so long takes only reallocate a handful of times
+  const int needed = recordedSamples + numSamples;
+  if (needed > recordBuffer.getNumSamples()) {
+    const int newSize = juce::jmax(
+        needed, recordBuffer.getNumSamples() * 2, (int)(sampleRate * 30.0));
+    recordBuffer.setSize(numChannels, newSize, true, false, true);
+  }
+
+  for (int channel = 0; channel < numChannels; ++channel)
+    recordBuffer.copyFrom(channel, recordedSamples, ring, channel, ringStart,
+                          numSamples);
+
+  recordedSamples = needed;
+}
+
+void LiveAnalyzer::startRecording() {
+  const juce::ScopedLock sl(recordLock);
+  recordedSamples = 0;
+  recordStart = -1; // Set by the analyzer thread on the next chunk
+  recordOnsets.clear();
+  recording = true;
+}
+
+void LiveAnalyzer::stopRecording(juce::AudioBuffer<float> &destination,
+                                 std::vector<int> &recordedOnsets) {
+  const juce::ScopedLock sl(recordLock);
+  recording = false;
+
+  // Move rather than copy, then trim the unused tail in place
+  destination = std::move(recordBuffer);
+  destination.setSize(numChannels, recordedSamples, true, false, true);
+  recordedOnsets = std::move(recordOnsets);
+
+  recordBuffer = juce::AudioBuffer<float>();
+  recordOnsets.clear();
+  recordedSamples = 0;
+}
+
+double LiveAnalyzer::getSecondsSinceLastOnset() const {
+  const juce::int64 last = lastOnsetSample.load();
+  if (last < 0)
+    return -1.0;
+  return (double)(consumedSamples.load() - last) / sampleRate;
+}
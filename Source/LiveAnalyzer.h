@@ -0,0 +1,84 @@
+#pragma once
+
+#include "AnalysisWorkspace.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <vector>
+
+// Streams the engine's input bus to a background thread for onset and tempo
+// tracking, and optionally records it. The audio thread only copies into a
+// lock-free FIFO; everything else (ODF, tempo, growing the recording) runs
+// on the analyzer thread. Onsets are reported at most one block + one 5ms
+// hop + one poll interval after they arrive at the input.
+class LiveAnalyzer : private juce::Thread {
+public:
+  LiveAnalyzer();
+  ~LiveAnalyzer() override;
+
+  void prepare(double sampleRate, int samplesPerBlock);
+  void release();
+
+  // Audio thread: never blocks or allocates. Drops input if the FIFO is full.
+  void pushBlock(const juce::AudioBuffer<float> &buffer, int numInputChannels);
+
+  void startRecording();
+  // Hands over the recording (trimmed, no copy) and the onsets detected
+  // while it was running, relative to its first sample
+  void stopRecording(juce::AudioBuffer<float> &destination,
+                     std::vector<int> &recordedOnsets);
+  bool isRecording() const { return recording.load(); }
+
+  double getSampleRate() const { return sampleRate; }
+  double getCurrentBpm() const { return currentBpm.load(); }
+  int getNumOnsets() const { return numOnsets.load(); }
+  double getSecondsSinceLastOnset() const;
+  int getDroppedSamples() const { return droppedSamples.load(); }
+
+private:
+  void run() override;
+  void processSamples(int ringStart, int numSamples);
+  void appendToRecording(int ringStart, int numSamples);
+
+  static constexpr int numChannels = 2;
+  static constexpr int pollIntervalMs = 2;
+  static constexpr double tempoHistorySeconds = 8.0;
+
+  double sampleRate = 44100.0;
+
+  // Audio thread -> analyzer thread
+  juce::AbstractFifo fifo{1};
+  juce::AudioBuffer<float> ring;
+  std::atomic<bool> active{false};
+  std::atomic<int> droppedSamples{0};
+
+  // Analyzer thread state
+  juce::int64 streamPosition = 0; // Samples consumed since prepare()
+  int hopSize = 0;
+  int hopFill = 0;
+  float hopEnergy = 0.0f;
+  float lastEnergy = 0.0f;
+  juce::int64 lastOnsetPosition = -1;
+  int minOnsetGap = 0;
+  std::vector<float> odfHistory; // Circular, tempoHistorySeconds long
+  std::vector<float> odfLinear;  // Unrolled copy for the tempo estimate
+  int odfWrite = 0;
+  int odfFrames = 0;
+  int framesSinceTempo = 0;
+  AnalysisWorkspace workspace;
+
+  // Results polled by the UI
+  std::atomic<double> currentBpm{0.0};
+  std::atomic<int> numOnsets{0};
+  std::atomic<juce::int64> lastOnsetSample{-1};
+  std::atomic<juce::int64> consumedSamples{0};
+
+  // Recording, shared between the analyzer and message threads
+  std::atomic<bool> recording{false};
+  juce::CriticalSection recordLock;
+  juce::AudioBuffer<float> recordBuffer;
+  int recordedSamples = 0;
+  juce::int64 recordStart = 0;
+  std::vector<int> recordOnsets;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LiveAnalyzer)
+};
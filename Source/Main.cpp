@@ -1,5 +1,8 @@
 #include <JuceHeader.h>
+#include "AnalysisKernels.h"
+#include "AudioAnalysis.h"
 #include "MainComponent.h"
+#include "RealtimeStressTest.h"
 
 class SamplerProApplication : public juce::JUCEApplication
 {
@@ -12,11 +15,49 @@ public:
 
     void initialise (const juce::String& commandLine) override
     {
+        // --rt-stress [seconds]: headless audio-thread stress run, no window
+        auto args = juce::StringArray::fromTokens (commandLine, true);
+        const int stressArg = args.indexOf ("--rt-stress");
+        if (stressArg >= 0)
+        {
+            const double seconds = args[stressArg + 1].getDoubleValue();
+            stressTest = std::make_unique<RealtimeStressTest> ([this] (int exitCode)
+            {
+                setApplicationReturnValue (exitCode);
+                quit();
+            });
+            stressTest->start (seconds > 0.0 ? seconds : 10.0);
+            return;
+        }
+
+        // --kernel-bench [seconds per kernel]: check the analysis kernels
+        // against the scalar reference and print their throughput
+        const int benchArg = args.indexOf ("--kernel-bench");
+        if (benchArg >= 0)
+        {
+            const double seconds = args[benchArg + 1].getDoubleValue();
+            const int failures = AnalysisKernels::runBenchmark (seconds > 0.0 ? seconds : 0.5);
+            setApplicationReturnValue (failures > 0 ? 1 : 0);
+            quit();
+            return;
+        }
+
+        // --onset-bench [seconds of audio]: time both onset engines
+        const int onsetBenchArg = args.indexOf ("--onset-bench");
+        if (onsetBenchArg >= 0)
+        {
+            const double seconds = args[onsetBenchArg + 1].getDoubleValue();
+            AudioAnalysis::runOnsetBenchmark (seconds > 0.0 ? seconds : 600.0);
+            quit();
+            return;
+        }
+
         mainWindow.reset (new MainWindow (getApplicationName()));
     }
 
     void shutdown() override
     {
+        stressTest = nullptr;
         mainWindow = nullptr;
     }
 
@@ -60,6 +101,7 @@ public:
 
 private:
     std::unique_ptr<MainWindow> mainWindow;
+    std::unique_ptr<RealtimeStressTest> stressTest;
 };
 
 START_JUCE_APPLICATION (SamplerProApplication)
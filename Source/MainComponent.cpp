@@ -1,25 +1,37 @@
 #include "MainComponent.h"
+#include "RealtimeChecks.h"
+#include "Tracing.h"
+#include <algorithm>
 
 MainComponent::MainComponent()
-    : waveformComponent(audioEngine.getThumbnail(),
+    : waveformComponent(audioEngine.getPeaks(),
                         &audioEngine.getAnalysis().onsets) {
   addAndMakeVisible(openButton);
   addAndMakeVisible(playButton);
   addAndMakeVisible(stopButton);
   addAndMakeVisible(exportMidiButton);
   addAndMakeVisible(exportSlicesButton);
+  addAndMakeVisible(recordButton);
+  addAndMakeVisible(compactButton);
   addAndMakeVisible(tempoSlider);
   addAndMakeVisible(tempoLabel);
   addAndMakeVisible(waveformComponent);
   addAndMakeVisible(statusLabel);
   addAndMakeVisible(zoomSlider);
   addAndMakeVisible(zoomLabel);
+  addAndMakeVisible(loadLabel);
+  addAndMakeVisible(onsetEngineBox);
+  addAndMakeVisible(sampleBox);
 
   // Styling
   zoomLabel.setFont(juce::Font(12.0f));
   zoomLabel.setColour(juce::Label::textColourId, juce::Colours::grey);
   zoomLabel.setJustificationType(juce::Justification::centred);
 
+  loadLabel.setFont(juce::Font(12.0f));
+  loadLabel.setColour(juce::Label::textColourId, juce::Colours::grey);
+  loadLabel.setJustificationType(juce::Justification::centredRight);
+
   auto setupButton = [this](juce::TextButton &b, juce::Colour c) {
     b.setColour(juce::TextButton::buttonColourId, darkHeaderColor);
     b.setColour(juce::TextButton::textColourOffId, juce::Colours::white);
@@ -31,6 +43,8 @@ MainComponent::MainComponent()
   setupButton(stopButton, juce::Colours::darkred);
   setupButton(exportMidiButton, juce::Colours::darkorange);
   setupButton(exportSlicesButton, juce::Colours::darkblue);
+  setupButton(recordButton, juce::Colours::red);
+  setupButton(compactButton, juce::Colours::darkcyan);
 
   statusLabel.setColour(juce::Label::textColourId, juce::Colours::white);
   tempoLabel.setColour(juce::Label::textColourId, juce::Colours::white);
@@ -42,17 +56,35 @@ MainComponent::MainComponent()
         "*.wav;*.aif;*.mp3");
 
     auto flags = juce::FileBrowserComponent::openMode |
-                 juce::FileBrowserComponent::canSelectFiles;
+                 juce::FileBrowserComponent::canSelectFiles |
+                 juce::FileBrowserComponent::canSelectMultipleItems;
 
     fileChooser->launchAsync(flags, [this](const juce::FileChooser &chooser) {
-      auto file = chooser.getResult();
-      if (file != juce::File{}) {
+      auto files = chooser.getResults();
+      if (!files.isEmpty()) {
         statusLabel.setText("Analyzing Sample...", juce::dontSendNotification);
-        audioEngine.loadFile(file);
+        audioEngine.loadFiles(files);
       }
     });
   };
 
+  recordButton.setClickingTogglesState(true);
+  recordButton.onClick = [this] {
+    if (recordButton.getToggleState()) {
+      audioEngine.startRecording();
+    } else {
+      audioEngine.stopRecording();
+    }
+  };
+
+  // Keeps 16/24-bit files in their native width; affects later loads only
+  compactButton.setClickingTogglesState(true);
+  compactButton.setToggleState(audioEngine.isCompactStorage(),
+                               juce::dontSendNotification);
+  compactButton.onClick = [this] {
+    audioEngine.setCompactStorage(compactButton.getToggleState());
+  };
+
   playButton.onClick = [this] { audioEngine.play(); };
   stopButton.onClick = [this] { audioEngine.stop(); };
 
@@ -86,6 +118,29 @@ MainComponent::MainComponent()
     });
   };
 
+  onsetEngineBox.addItem("Energy Onsets", 1);
+  onsetEngineBox.addItem("Spectral Onsets", 2);
+  onsetEngineBox.setSelectedId(1, juce::dontSendNotification);
+  onsetEngineBox.onChange = [this] {
+    auto options = audioEngine.getAnalysisOptions();
+    options.onsetEngine = onsetEngineBox.getSelectedId() == 2
+                              ? AudioAnalysis::OnsetEngine::spectralFlux
+                              : AudioAnalysis::OnsetEngine::energy;
+    audioEngine.setAnalysisOptions(options);
+
+    if (audioEngine.getLengthInSeconds() > 0) {
+      statusLabel.setText("Analyzing Sample...", juce::dontSendNotification);
+      audioEngine.runAnalysis();
+    }
+  };
+
+  sampleBox.setTextWhenNothingSelected("No samples");
+  sampleBox.onChange = [this] {
+    const int index = sampleBox.getSelectedItemIndex();
+    if (index >= 0 && !audioEngine.selectSample(index))
+      refreshSampleList(); // Still loading; put the selection back
+  };
+
   tempoSlider.setRange(20.0, 280.0, 0.1);
   tempoSlider.onValueChange = [this] {
     audioEngine.setTempo(tempoSlider.getValue());
@@ -98,11 +153,17 @@ MainComponent::MainComponent()
   zoomSlider.setValue(1.0);
   zoomSlider.onValueChange = [this] {
     waveformComponent.setZoomLevel(zoomSlider.getValue());
+    audioEngine.setViewZoom(zoomSlider.getValue());
+  };
+
+  waveformComponent.onOnsetsEdited = [this] {
+    audioEngine.markAnalysisEdited();
   };
 
   waveformComponent.onZoomChanged = [this] {
     zoomSlider.setValue(waveformComponent.getZoomLevel(),
                         juce::dontSendNotification);
+    audioEngine.setViewZoom(waveformComponent.getZoomLevel());
   };
 
   statusLabel.setText("Sampler Pro - Ready (Drag & Drop Supported)",
@@ -113,20 +174,41 @@ MainComponent::MainComponent()
 
   waveformComponent.onSliceClicked = [this](int index) {
     audioEngine.playSlice(index);
+    lastClickedSlice = index;
+
+    auto &slices = audioEngine.getAnalysis().slices;
+    if (index < slices.size()) {
+      const auto i = (size_t)index;
+      statusLabel.setText(
+          "Slice " + juce::String(index + 1) + ": " +
+              juce::String(slices.duration[i], 2) + " s | Pitch: " +
+              juce::String(slices.pitch[i], 1) + " Hz | " +
+              juce::String(slices.loudness[i], 1) + " LUFS | Peak: " +
+              juce::String(juce::Decibels::gainToDecibels(slices.peak[i]), 1) +
+              " dB | Centroid: " + juce::String(slices.centroid[i], 0) + " Hz",
+          juce::dontSendNotification);
+    }
   };
 
   setWantsKeyboardFocus(true);
 
   startTimerHz(60);
 
+  // Pick up where the last run left off
+  if (audioEngine.openSession(AudioEngine::getDefaultSessionFile()))
+    zoomSlider.setValue(audioEngine.getViewZoom(), juce::sendNotificationSync);
+
   // Initialize audio
-  setAudioChannels(0, 2);
+  setAudioChannels(2, 2);
 
   setSize(900, 600);
 }
 
 MainComponent::~MainComponent() {
   audioEngine.removeChangeListener(this);
+  // The view may hold peaks mapped from the session file being replaced
+  waveformComponent.setPeaks(nullptr);
+  audioEngine.saveSession(AudioEngine::getDefaultSessionFile());
   shutdownAudio();
 }
 
@@ -150,12 +232,15 @@ void MainComponent::resized() {
   auto headerArea = bounds.removeFromTop(100).reduced(10, 5);
 
   auto buttonArea = headerArea.removeFromTop(40);
+  loadLabel.setBounds(buttonArea.removeFromRight(220));
   int btnWidth = 80;
   openButton.setBounds(buttonArea.removeFromLeft(btnWidth).reduced(2));
   playButton.setBounds(buttonArea.removeFromLeft(btnWidth).reduced(2));
   stopButton.setBounds(buttonArea.removeFromLeft(btnWidth).reduced(2));
   exportMidiButton.setBounds(buttonArea.removeFromLeft(btnWidth).reduced(2));
   exportSlicesButton.setBounds(buttonArea.removeFromLeft(btnWidth).reduced(2));
+  recordButton.setBounds(buttonArea.removeFromLeft(btnWidth).reduced(2));
+  compactButton.setBounds(buttonArea.removeFromLeft(btnWidth).reduced(2));
 
   auto controlArea = headerArea;
   auto tempoArea = controlArea.removeFromLeft(200);
@@ -166,6 +251,9 @@ void MainComponent::resized() {
   zoomLabel.setBounds(zoomArea.removeFromLeft(60));
   zoomSlider.setBounds(zoomArea);
 
+  onsetEngineBox.setBounds(controlArea.removeFromLeft(150).reduced(2, 8));
+  sampleBox.setBounds(controlArea.removeFromLeft(200).reduced(2, 8));
+
   statusLabel.setBounds(controlArea);
 
   bounds.reduce(20, 10);
@@ -183,29 +271,144 @@ bool MainComponent::isInterestedInFileDrag(const juce::StringArray &files) {
 }
 
 void MainComponent::filesDropped(const juce::StringArray &files, int x, int y) {
-  if (files.size() > 0) {
+  juce::Array<juce::File> toLoad;
+  for (auto &path : files)
+    toLoad.add(juce::File(path));
+
+  if (!toLoad.isEmpty()) {
     statusLabel.setText("Analyzing Sample...", juce::dontSendNotification);
-    audioEngine.loadFile(juce::File(files[0]));
+    audioEngine.loadFiles(toLoad);
   }
 }
 
 void MainComponent::changeListenerCallback(juce::ChangeBroadcaster *source) {
   if (source == &audioEngine) {
     auto &analysis = audioEngine.getAnalysis();
-    statusLabel.setText("BPM: " + juce::String(analysis.bpm, 1) + " | Pitch: " +
+    juce::String bpmText = "BPM: " + juce::String(analysis.bpm, 1);
+    if (!analysis.beatTempos.empty()) {
+      auto range = std::minmax_element(analysis.beatTempos.begin(),
+                                       analysis.beatTempos.end());
+      bpmText += " (" + juce::String(*range.first, 1) + "-" +
+                 juce::String(*range.second, 1) + ")";
+    }
+    statusLabel.setText(bpmText + " | Pitch: " +
                             juce::String(analysis.frequency, 1) + " Hz",
                         juce::dontSendNotification);
 
     tempoSlider.setValue(analysis.bpm, juce::dontSendNotification);
     waveformComponent.setSampleRate(audioEngine.getFileSampleRate());
+    waveformComponent.setPeaks(audioEngine.getPeaks());
     waveformComponent.setOnsets(
         &analysis.onsets); // Refresh the pointer/reference
     waveformComponent.repaint();
+    refreshSampleList();
+  }
+}
+
+void MainComponent::refreshSampleList() {
+  auto &pool = audioEngine.getSamplePool();
+  const int numSamples = pool.getNumSamples();
+
+  if (sampleBox.getNumItems() != numSamples) {
+    sampleBox.clear(juce::dontSendNotification);
+    for (int i = 0; i < numSamples; ++i)
+      sampleBox.addItem(pool.getName(i), i + 1);
+  }
+
+  // Files that failed to load keep their place but cannot be picked
+  for (int i = 0; i < numSamples; ++i) {
+    const bool failed = pool.hasFailed(i);
+    const auto text = pool.getName(i) + (failed ? " (failed to load)" : "");
+    if (sampleBox.getItemText(i) != text)
+      sampleBox.changeItemText(i + 1, text);
+    sampleBox.setItemEnabled(i + 1, !failed);
   }
+
+  sampleBox.setSelectedItemIndex(audioEngine.getCurrentSample(),
+                                 juce::dontSendNotification);
 }
 
 void MainComponent::timerCallback() {
   waveformComponent.setPlayheadTime(audioEngine.getCurrentPosition());
+
+  auto profile = audioEngine.getRenderProfiler().getSnapshot();
+  juce::String load = "DSP " + juce::String(profile.averageLoad * 100.0, 1) +
+                      "% | Peak " + juce::String(profile.peakLoad * 100.0, 1) +
+                      "% | Xruns " + juce::String(profile.getXruns());
+#if SAMPLER_PRO_RT_CHECKS
+  load << " | RT " << RealtimeChecker::getInstance().getTotalCount();
+#endif
+  loadLabel.setText(load, juce::dontSendNotification);
+
+  if (audioEngine.isRecording()) {
+    auto &live = audioEngine.getLiveAnalyzer();
+    bool onsetFlash = live.getSecondsSinceLastOnset() >= 0.0 &&
+                      live.getSecondsSinceLastOnset() < 0.1;
+    statusLabel.setText("REC | Live BPM: " +
+                            juce::String(live.getCurrentBpm(), 1) +
+                            " | Onsets: " + juce::String(live.getNumOnsets()) +
+                            (onsetFlash ? " *" : ""),
+                        juce::dontSendNotification);
+  }
+}
+
+void MainComponent::findSimilarSlice() {
+  auto similar = audioEngine.findSimilarSlices(lastClickedSlice, 10);
+  if (similar.empty()) {
+    statusLabel.setText("Click a slice first, then press F to find similar",
+                        juce::dontSendNotification);
+    return;
+  }
+
+  auto &best = similar.front();
+  const bool pooled = audioEngine.jumpToSlice(best.file, best.start);
+  statusLabel.setText("Most similar: " + best.file.getFileName() + " @ " +
+                          juce::String(best.start /
+                                           audioEngine.getFileSampleRate(),
+                                       2) +
+                          " s (distance " + juce::String(best.distance, 2) +
+                          ")" + (pooled ? "" : " - loading"),
+                      juce::dontSendNotification);
+  lastClickedSlice = -1;
+}
+
+void MainComponent::exportProfilerReport() {
+  auto report = audioEngine.getRenderProfiler().createReport();
+
+  fileChooser = std::make_unique<juce::FileChooser>(
+      "Export Audio Profile...",
+      juce::File::getSpecialLocation(juce::File::userHomeDirectory), "*.csv");
+
+  auto flags = juce::FileBrowserComponent::saveMode |
+               juce::FileBrowserComponent::warnAboutOverwriting;
+
+  fileChooser->launchAsync(flags, [report](const juce::FileChooser &chooser) {
+    auto file = chooser.getResult();
+    if (file != juce::File{})
+      file.replaceWithText(report);
+  });
+}
+
+void MainComponent::exportTrace() {
+#if SAMPLER_PRO_TRACING
+  fileChooser = std::make_unique<juce::FileChooser>(
+      "Export Analysis Trace...",
+      juce::File::getSpecialLocation(juce::File::userHomeDirectory),
+      "*.json");
+
+  auto flags = juce::FileBrowserComponent::saveMode |
+               juce::FileBrowserComponent::warnAboutOverwriting;
+
+  fileChooser->launchAsync(flags, [](const juce::FileChooser &chooser) {
+    auto file = chooser.getResult();
+    if (file != juce::File{})
+      Tracer::getInstance().writeChromeTrace(file);
+  });
+#else
+  statusLabel.setText("Tracing disabled (configure with "
+                      "-DSAMPLER_PRO_TRACING=ON)",
+                      juce::dontSendNotification);
+#endif
 }
 
 bool MainComponent::keyPressed(const juce::KeyPress &key) {
@@ -216,5 +419,21 @@ bool MainComponent::keyPressed(const juce::KeyPress &key) {
       audioEngine.play();
     return true;
   }
+  if (key.getTextCharacter() == 'p') {
+    exportProfilerReport();
+    return true;
+  }
+  if (key.getTextCharacter() == 't') {
+    exportTrace();
+    return true;
+  }
+  if (key.getTextCharacter() == 'r') {
+    audioEngine.getRenderProfiler().reset();
+    return true;
+  }
+  if (key.getTextCharacter() == 'f') {
+    findSimilarSlice();
+    return true;
+  }
   return false;
 }
@@ -42,6 +42,11 @@ private:
   juce::TextButton stopButton{"STOP"};
   juce::TextButton exportMidiButton{"MIDI"};
   juce::TextButton exportSlicesButton{"SLICES"};
+  juce::TextButton recordButton{"REC"};
+  juce::TextButton compactButton{"16/24"};
+
+  juce::ComboBox onsetEngineBox;
+  juce::ComboBox sampleBox;
 
   juce::Slider tempoSlider;
   juce::Slider zoomSlider;
@@ -49,8 +54,15 @@ private:
   juce::Label tempoLabel{"Tempo:", "Tempo:"};
 
   juce::Label statusLabel;
+  juce::Label loadLabel;
 
   std::unique_ptr<juce::FileChooser> fileChooser;
+  int lastClickedSlice = -1;
+
+  void refreshSampleList();
+  void findSimilarSlice();
+  void exportProfilerReport();
+  void exportTrace();
 
   // Custom native aesthetic colors
   const juce::Colour darkHeaderColor = juce::Colour::greyLevel(0.1f);
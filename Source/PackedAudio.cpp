@@ -0,0 +1,169 @@
+#include "PackedAudio.h"
+#include <cmath>
+
+#if JUCE_USE_SSE_INTRINSICS
+#include <emmintrin.h>
+#endif
+
+namespace {
+void decodeInt16(const juce::int16 *source, float *destination,
+                 int numSamples) {
+  constexpr float scale = 1.0f / 32768.0f;
+  int i = 0;
+
+#if JUCE_USE_SSE_INTRINSICS
+  // Sign-extend eight samples to 32 bits by placing each in the top half of
+  // a lane and shifting back down, then convert
+  const __m128 scaleVector = _mm_set1_ps(scale);
+  for (; i + 8 <= numSamples; i += 8) {
+    const __m128i packed =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i));
+    const __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+    const __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+    _mm_storeu_ps(destination + i,
+                  _mm_mul_ps(_mm_cvtepi32_ps(low), scaleVector));
+    _mm_storeu_ps(destination + i + 4,
+                  _mm_mul_ps(_mm_cvtepi32_ps(high), scaleVector));
+  }
+#endif
+
+  for (; i < numSamples; ++i)
+    destination[i] = (float)source[i] * scale;
+}
+
+void decodeInt24(const juce::uint8 *source, float *destination,
+                 int numSamples) {
+  // Assemble into the top three bytes of an int32 so the sign comes for free
+  constexpr float scale = 1.0f / 2147483648.0f;
+  int i = 0;
+
+#if JUCE_USE_SSE_INTRINSICS
+  // SSE2 has no byte shuffle, so four samples are lined up with whole-vector
+  // byte shifts instead: shifting left by k bytes moves sample k to the start
+  // of lane k, the masks keep that lane from each shift, and a 32-bit shift
+  // moves the sample into the top three bytes. Each 16-byte load reaches
+  // past the four samples it decodes, hence the two to spare.
+  const __m128 scaleVector = _mm_set1_ps(scale);
+  const __m128i lane0 = _mm_setr_epi32(-1, 0, 0, 0);
+  const __m128i lane1 = _mm_setr_epi32(0, -1, 0, 0);
+  const __m128i lane2 = _mm_setr_epi32(0, 0, -1, 0);
+  const __m128i lane3 = _mm_setr_epi32(0, 0, 0, -1);
+  for (; i + 6 <= numSamples; i += 4) {
+    const __m128i packed =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + 3 * i));
+    const __m128i spread = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(packed, lane0),
+                     _mm_and_si128(_mm_slli_si128(packed, 1), lane1)),
+        _mm_or_si128(_mm_and_si128(_mm_slli_si128(packed, 2), lane2),
+                     _mm_and_si128(_mm_slli_si128(packed, 3), lane3)));
+    const __m128i values = _mm_slli_epi32(spread, 8);
+    _mm_storeu_ps(destination + i,
+                  _mm_mul_ps(_mm_cvtepi32_ps(values), scaleVector));
+  }
+#endif
+
+  for (source += 3 * i; i < numSamples; ++i, source += 3) {
+    const auto value = (juce::int32)((juce::uint32)source[0] << 8 |
+                                     (juce::uint32)source[1] << 16 |
+                                     (juce::uint32)source[2] << 24);
+    destination[i] = (float)value * scale;
+  }
+}
+} // namespace
+
+PackedAudioBuffer::PackedAudioBuffer(const juce::AudioBuffer<float> &source,
+                                     Format formatToUse)
+    : format(formatToUse), numChannels(source.getNumChannels()),
+      numSamples(source.getNumSamples()) {
+  data.resize((size_t)numChannels * (size_t)numSamples *
+              (size_t)getBytesPerSample());
+
+  const double fullScale = format == Format::int16 ? 32768.0 : 8388608.0;
+  const int maximum = (int)fullScale - 1, minimum = -(int)fullScale;
+
+  for (int channel = 0; channel < numChannels; ++channel) {
+    const float *input = source.getReadPointer(channel);
+    auto *output = data.data() + (size_t)channel * (size_t)numSamples *
+                                     (size_t)getBytesPerSample();
+
+    for (int i = 0; i < numSamples; ++i) {
+      const int value = juce::jlimit(
+          minimum, maximum, (int)std::lround(input[i] * fullScale));
+
+      if (format == Format::int16) {
+        const auto bits = (juce::uint16)(juce::int16)value;
+        output[2 * i] = (juce::uint8)(bits & 0xff);
+        output[2 * i + 1] = (juce::uint8)(bits >> 8);
+      } else {
+        const auto bits = (juce::uint32)value;
+        output[3 * i] = (juce::uint8)(bits & 0xff);
+        output[3 * i + 1] = (juce::uint8)((bits >> 8) & 0xff);
+        output[3 * i + 2] = (juce::uint8)((bits >> 16) & 0xff);
+      }
+    }
+  }
+}
+
+void PackedAudioBuffer::read(int channel, int sourceStart, float *destination,
+                             int numSamplesToRead) const {
+  jassert(sourceStart >= 0 && sourceStart + numSamplesToRead <= numSamples);
+
+  const auto *source =
+      getChannelData(channel) + (size_t)sourceStart * getBytesPerSample();
+  if (format == Format::int16)
+    decodeInt16(reinterpret_cast<const juce::int16 *>(source), destination,
+                numSamplesToRead);
+  else
+    decodeInt24(source, destination, numSamplesToRead);
+}
+
+void PackedAudioBuffer::read(juce::AudioBuffer<float> &destination,
+                             int destinationStart, int sourceStart,
+                             int numSamplesToRead) const {
+  const int channels = juce::jmin(numChannels, destination.getNumChannels());
+  for (int channel = 0; channel < channels; ++channel)
+    read(channel, sourceStart,
+         destination.getWritePointer(channel, destinationStart),
+         numSamplesToRead);
+}
+
+PackedAudioSource::PackedAudioSource(
+    std::shared_ptr<const PackedAudioBuffer> audioToPlay)
+    : audio(std::move(audioToPlay)) {}
+
+void PackedAudioSource::getNextAudioBlock(
+    const juce::AudioSourceChannelInfo &info) {
+  auto &buffer = *info.buffer;
+  const int total = audio->getNumSamples();
+  const int sourceChannels = audio->getNumChannels();
+
+  if (total == 0 || sourceChannels == 0) {
+    info.clearActiveBufferRegion();
+    return;
+  }
+
+  int written = 0;
+  while (written < info.numSamples) {
+    if (position >= total) {
+      if (!looping)
+        break;
+      position = 0;
+    }
+
+    const int chunk =
+        (int)juce::jmin((juce::int64)(info.numSamples - written),
+                        (juce::int64)total - position);
+
+    // Mono material feeds every output channel
+    for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+      audio->read(juce::jmin(channel, sourceChannels - 1), (int)position,
+                  buffer.getWritePointer(channel, info.startSample + written),
+                  chunk);
+
+    written += chunk;
+    position += chunk;
+  }
+
+  if (written < info.numSamples)
+    buffer.clear(info.startSample + written, info.numSamples - written);
+}
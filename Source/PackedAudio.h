@@ -0,0 +1,71 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+// Samples kept in their native 16- or 24-bit PCM width instead of 32-bit
+// float, roughly halving (24-bit: 25% less) the memory of a loaded file.
+// Readers convert blocks back to float on the fly; the 16-bit path uses
+// SSE2 where available.
+class PackedAudioBuffer {
+public:
+  enum class Format { int16, int24 };
+
+  // Quantises source, which must hold values decoded from PCM of the same
+  // width for the round trip to be lossless
+  PackedAudioBuffer(const juce::AudioBuffer<float> &source, Format format);
+
+  Format getFormat() const { return format; }
+  int getNumChannels() const { return numChannels; }
+  int getNumSamples() const { return numSamples; }
+  juce::int64 getSizeInBytes() const { return (juce::int64)data.size(); }
+
+  // Converts numSamples from sourceStart of one channel into destination
+  void read(int channel, int sourceStart, float *destination,
+            int numSamples) const;
+  // Same for every channel destination and this buffer have in common
+  void read(juce::AudioBuffer<float> &destination, int destinationStart,
+            int sourceStart, int numSamples) const;
+
+private:
+  int getBytesPerSample() const { return format == Format::int16 ? 2 : 3; }
+  const juce::uint8 *getChannelData(int channel) const {
+    return data.data() +
+           (size_t)channel * (size_t)numSamples * (size_t)getBytesPerSample();
+  }
+
+  Format format;
+  int numChannels = 0;
+  int numSamples = 0;
+  std::vector<juce::uint8> data; // Channel-major, little-endian
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PackedAudioBuffer)
+};
+
+// Plays a PackedAudioBuffer, decoding each block as it is pulled
+class PackedAudioSource : public juce::PositionableAudioSource {
+public:
+  explicit PackedAudioSource(std::shared_ptr<const PackedAudioBuffer> audio);
+
+  void prepareToPlay(int, double) override {}
+  void releaseResources() override {}
+  void getNextAudioBlock(const juce::AudioSourceChannelInfo &info) override;
+
+  void setNextReadPosition(juce::int64 newPosition) override {
+    position = newPosition;
+  }
+  juce::int64 getNextReadPosition() const override { return position; }
+  juce::int64 getTotalLength() const override {
+    return audio->getNumSamples();
+  }
+  bool isLooping() const override { return looping; }
+  void setLooping(bool shouldLoop) override { looping = shouldLoop; }
+
+private:
+  std::shared_ptr<const PackedAudioBuffer> audio;
+  juce::int64 position = 0;
+  bool looping = false;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PackedAudioSource)
+};
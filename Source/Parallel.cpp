@@ -0,0 +1,88 @@
+#include "Parallel.h"
+
+ParallelPool &ParallelPool::getInstance() {
+  static ParallelPool instance;
+  return instance;
+}
+
+ParallelPool::ParallelPool() {
+  const int numWorkers = juce::jmax(0, juce::SystemStats::getNumCpus() - 1);
+  workers.reserve((size_t)numWorkers);
+  for (int i = 0; i < numWorkers; ++i)
+    workers.emplace_back([this, i] { workerLoop(i + 1); });
+}
+
+ParallelPool::~ParallelPool() {
+  {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    quit = true;
+  }
+  wake.notify_all();
+
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void ParallelPool::run(int count, Task task, void *context) {
+  if (count <= 0)
+    return;
+
+  bool expected = false;
+  if (workers.empty() || count == 1 ||
+      !busy.compare_exchange_strong(expected, true)) {
+    for (int i = 0; i < count; ++i)
+      task(context, i, 0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    currentTask = task;
+    currentContext = context;
+    taskCount = count;
+    activeWorkers = (int)workers.size();
+    nextIndex.store(0);
+    ++generation;
+  }
+  wake.notify_all();
+
+  runTasks(0);
+
+  {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    finished.wait(lock, [this] { return activeWorkers == 0; });
+    currentTask = nullptr;
+    currentContext = nullptr;
+  }
+
+  busy.store(false);
+}
+
+void ParallelPool::runTasks(int worker) {
+  for (int i = nextIndex.fetch_add(1); i < taskCount;
+       i = nextIndex.fetch_add(1))
+    currentTask(currentContext, i, worker);
+}
+
+void ParallelPool::workerLoop(int worker) {
+  juce::uint64 seenGeneration = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(stateMutex);
+      wake.wait(lock,
+                [&] { return quit || generation != seenGeneration; });
+      if (quit)
+        return;
+      seenGeneration = generation;
+    }
+
+    runTasks(worker);
+
+    {
+      std::lock_guard<std::mutex> lock(stateMutex);
+      if (--activeWorkers == 0)
+        finished.notify_one();
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A fixed set of worker threads shared by all analysis code. Jobs are passed
+// as a plain function pointer and context, so dispatching never allocates.
+// Only one job runs on the pool at a time; a caller that finds it busy (or
+// calls in from inside a job) simply runs its work inline.
+class ParallelPool {
+public:
+  static ParallelPool &getInstance();
+  ~ParallelPool();
+
+  // Upper bound for the worker index handed to jobs
+  int getNumWorkers() const { return (int)workers.size() + 1; }
+
+  // Calls function(index, worker) for every index in [0, count). Indices are
+  // claimed dynamically; worker is stable within a thread for per-thread
+  // scratch space.
+  template <typename Function> void forEach(int count, Function &&function) {
+    using FunctionType = std::remove_reference_t<Function>;
+    auto trampoline = [](void *context, int index, int worker) {
+      (*static_cast<FunctionType *>(context))(index, worker);
+    };
+    run(count, trampoline,
+        const_cast<void *>(static_cast<const void *>(&function)));
+  }
+
+private:
+  ParallelPool();
+
+  using Task = void (*)(void *context, int index, int worker);
+  void run(int count, Task task, void *context);
+  void runTasks(int worker);
+  void workerLoop(int worker);
+
+  std::vector<std::thread> workers;
+  std::atomic<bool> busy{false};
+
+  std::mutex stateMutex;
+  std::condition_variable wake, finished;
+  Task currentTask = nullptr;
+  void *currentContext = nullptr;
+  int taskCount = 0;
+  int activeWorkers = 0;
+  juce::uint64 generation = 0;
+  bool quit = false;
+  std::atomic<int> nextIndex{0};
+
+  JUCE_DECLARE_NON_COPYABLE(ParallelPool)
+};
+
+// Runs function(index, worker) for every index in [0, count) on the shared
+// pool. The calling thread always takes part as worker 0.
+template <typename Function> void parallelFor(int count, Function &&function) {
+  ParallelPool::getInstance().forEach(count, std::forward<Function>(function));
+}
@@ -0,0 +1,262 @@
+#include "RealtimeChecks.h"
+
+#if SAMPLER_PRO_RT_CHECKS
+
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+thread_local int RealtimeChecker::realtimeDepth = 0;
+thread_local int RealtimeChecker::lockAllowanceDepth = 0;
+thread_local int RealtimeChecker::suspendDepth = 0;
+
+RealtimeChecker &RealtimeChecker::getInstance() {
+  static RealtimeChecker instance;
+  return instance;
+}
+
+namespace {
+using Violation = RealtimeChecker::Violation;
+
+// Constructed before main so no report ever runs a static initialiser
+[[maybe_unused]] RealtimeChecker &startupInstance =
+    RealtimeChecker::getInstance();
+
+inline void check(Violation violation) {
+  if (RealtimeChecker::isCheckedThread())
+    RealtimeChecker::report(violation);
+}
+} // namespace
+
+const char *RealtimeChecker::getName(Violation violation) {
+  switch (violation) {
+  case Violation::allocation:
+    return "allocation";
+  case Violation::deallocation:
+    return "deallocation";
+  case Violation::lock:
+    return "lock";
+  case Violation::contendedLock:
+    return "contended lock";
+  case Violation::wait:
+    return "wait";
+  case Violation::sleep:
+    return "sleep";
+  case Violation::io:
+    return "io";
+  case Violation::numViolations:
+    break;
+  }
+  return "unknown";
+}
+
+void RealtimeChecker::report(Violation violation) {
+  // Everything below may allocate or lock in turn
+  ++suspendDepth;
+
+  auto &checker = getInstance();
+  checker.counts[(int)violation].fetch_add(1, std::memory_order_relaxed);
+
+  // Contention traces would only crowd out the ones worth reading
+  bool wantsTrace = violation != Violation::contendedLock;
+  if (wantsTrace) {
+    const juce::SpinLock::ScopedLockType sl(checker.traceLock);
+    wantsTrace = checker.stackTraces.size() < maxStackTraces;
+  }
+
+  if (wantsTrace) {
+    auto trace = juce::String(getName(violation)) + " on the audio thread\n" +
+                 juce::SystemStats::getStackBacktrace();
+
+    const juce::SpinLock::ScopedLockType sl(checker.traceLock);
+    if (checker.stackTraces.size() < maxStackTraces)
+      checker.stackTraces.add(trace);
+  }
+
+  --suspendDepth;
+}
+
+juce::int64 RealtimeChecker::getCount(Violation violation) const {
+  return counts[(int)violation].load(std::memory_order_relaxed);
+}
+
+juce::int64 RealtimeChecker::getTotalCount() const {
+  juce::int64 total = 0;
+  for (int i = 0; i < numViolationKinds; ++i)
+    if ((Violation)i != Violation::contendedLock)
+      total += getCount((Violation)i);
+  return total;
+}
+
+juce::StringArray RealtimeChecker::getStackTraces() const {
+  const juce::SpinLock::ScopedLockType sl(traceLock);
+  return stackTraces;
+}
+
+juce::String RealtimeChecker::createReport() const {
+  juce::String report;
+  report << "Audio thread violations: " << getTotalCount() << "\n";
+  for (int i = 0; i < numViolationKinds; ++i)
+    if ((Violation)i != Violation::contendedLock)
+      report << "  " << getName((Violation)i) << ": "
+             << getCount((Violation)i) << "\n";
+  report << "Allowed locks found contended (not counted): "
+         << getCount(Violation::contendedLock) << "\n";
+
+  for (auto &trace : getStackTraces())
+    report << "\n" << trace;
+
+  return report;
+}
+
+void RealtimeChecker::reset() {
+  for (auto &count : counts)
+    count.store(0, std::memory_order_relaxed);
+
+  const juce::SpinLock::ScopedLockType sl(traceLock);
+  stackTraces.clear();
+}
+
+//==============================================================================
+#if JUCE_LINUX
+
+// glibc's own entry points, so the hooks never have to look malloc up
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(size_t size) {
+  check(Violation::allocation);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+  check(Violation::allocation);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+  check(Violation::allocation);
+  return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) {
+  if (pointer != nullptr)
+    check(Violation::deallocation);
+  __libc_free(pointer);
+}
+}
+
+#else
+
+// operator new/delete; malloc itself is not hooked on these platforms
+void *operator new(std::size_t size) {
+  check(Violation::allocation);
+  if (auto *pointer = std::malloc(size == 0 ? 1 : size))
+    return pointer;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void operator delete(void *pointer) noexcept {
+  if (pointer != nullptr)
+    check(Violation::deallocation);
+  std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept { operator delete(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept {
+  operator delete(pointer);
+}
+void operator delete[](void *pointer, std::size_t) noexcept {
+  operator delete(pointer);
+}
+
+#endif
+
+//==============================================================================
+// Only Linux resolves these through the global symbol table. On macOS the
+// two-level namespace binds libSystem calls made by the system frameworks
+// straight to libSystem, so a definition here would miss most of them.
+#if JUCE_LINUX
+
+namespace {
+template <typename Function>
+Function *findNext(const char *name, const char *version = nullptr) {
+  // The unversioned lookup returns the pre-2.3.2 condition variable ABI
+  if (version != nullptr)
+    if (auto *symbol = dlvsym(RTLD_NEXT, name, version))
+      return reinterpret_cast<Function *>(symbol);
+  return reinterpret_cast<Function *>(dlsym(RTLD_NEXT, name));
+}
+} // namespace
+
+extern "C" {
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+  static auto *next = findNext<int(pthread_mutex_t *)>("pthread_mutex_lock");
+
+  if (RealtimeChecker::isCheckedThread()) {
+    if (!RealtimeChecker::isLockAllowed())
+      RealtimeChecker::report(Violation::lock);
+    else if (pthread_mutex_trylock(mutex) == 0)
+      return 0;
+    else
+      RealtimeChecker::report(Violation::contendedLock);
+  }
+  return next(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t *condition, pthread_mutex_t *mutex) {
+  static auto *next = findNext<int(pthread_cond_t *, pthread_mutex_t *)>(
+      "pthread_cond_wait", "GLIBC_2.3.2");
+  check(Violation::wait);
+  return next(condition, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *condition, pthread_mutex_t *mutex,
+                           const struct timespec *time) {
+  static auto *next = findNext<int(pthread_cond_t *, pthread_mutex_t *,
+                                   const struct timespec *)>(
+      "pthread_cond_timedwait", "GLIBC_2.3.2");
+  check(Violation::wait);
+  return next(condition, mutex, time);
+}
+
+int nanosleep(const struct timespec *duration, struct timespec *remaining) {
+  static auto *next =
+      findNext<int(const struct timespec *, struct timespec *)>("nanosleep");
+  check(Violation::sleep);
+  return next(duration, remaining);
+}
+
+int usleep(useconds_t microseconds) {
+  static auto *next = findNext<int(useconds_t)>("usleep");
+  check(Violation::sleep);
+  return next(microseconds);
+}
+
+ssize_t read(int descriptor, void *buffer, size_t size) {
+  static auto *next = findNext<ssize_t(int, void *, size_t)>("read");
+  check(Violation::io);
+  return next(descriptor, buffer, size);
+}
+
+ssize_t write(int descriptor, const void *buffer, size_t size) {
+  static auto *next = findNext<ssize_t(int, const void *, size_t)>("write");
+  check(Violation::io);
+  return next(descriptor, buffer, size);
+}
+}
+
+#endif
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef SAMPLER_PRO_RT_CHECKS
+#define SAMPLER_PRO_RT_CHECKS 0
+#endif
+
+#if SAMPLER_PRO_RT_CHECKS
+
+#include <atomic>
+
+// Flags calls that have no business on the audio thread. On Linux malloc,
+// free, the pthread mutex and condition entry points, sleeps and read/write
+// are interposed; on macOS and Windows operator new/delete only. A hooked
+// call made inside a SAMPLER_RT_SCOPE is counted, and the first few also
+// keep a stack trace.
+// With SAMPLER_PRO_RT_CHECKS off the macros expand to nothing.
+class RealtimeChecker {
+public:
+  enum class Violation {
+    allocation,
+    deallocation,
+    lock,          // Any mutex acquisition outside an allowance
+    contendedLock, // A lock allowed when free, but another thread held it;
+                   // reported apart from the rest, see getTotalCount()
+    wait,          // Condition variable waits
+    sleep,
+    io,
+    numViolations
+  };
+
+  static RealtimeChecker &getInstance();
+  static const char *getName(Violation violation);
+
+  juce::int64 getCount(Violation violation) const;
+  // Every kind except contendedLock. Contention says as much about the
+  // other thread as about the audio thread, and the transport's callback
+  // lock is shared with whichever thread calls start(), stop() or
+  // setPosition(), so it is reported but never fails a run.
+  juce::int64 getTotalCount() const;
+  juce::StringArray getStackTraces() const;
+  juce::String createReport() const;
+  void reset();
+
+  // Called by the hooks; cheap unless the calling thread is in a scope
+  static bool isCheckedThread() {
+    return realtimeDepth > 0 && suspendDepth == 0;
+  }
+  static bool isLockAllowed() { return lockAllowanceDepth > 0; }
+  static void report(Violation violation);
+
+  // Marks the calling thread as real-time while the scope lives
+  class ScopedRealtimeSection {
+  public:
+    ScopedRealtimeSection() { ++realtimeDepth; }
+    ~ScopedRealtimeSection() { --realtimeDepth; }
+
+    JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeSection)
+  };
+
+  // For third-party code whose uncontended lock is a known quantity (the
+  // transport's callback lock). Allocations are still flagged, and so is
+  // the lock if it actually has to wait.
+  class ScopedLockAllowance {
+  public:
+    ScopedLockAllowance() { ++lockAllowanceDepth; }
+    ~ScopedLockAllowance() { --lockAllowanceDepth; }
+
+    JUCE_DECLARE_NON_COPYABLE(ScopedLockAllowance)
+  };
+
+private:
+  RealtimeChecker() = default;
+
+  static constexpr int maxStackTraces = 8;
+  static constexpr int numViolationKinds = (int)Violation::numViolations;
+
+  static thread_local int realtimeDepth;
+  static thread_local int lockAllowanceDepth;
+  static thread_local int suspendDepth; // Set while reporting
+
+  std::atomic<juce::int64> counts[numViolationKinds] = {};
+  mutable juce::SpinLock traceLock;
+  juce::StringArray stackTraces;
+
+  JUCE_DECLARE_NON_COPYABLE(RealtimeChecker)
+};
+
+#define SAMPLER_RT_SCOPE()                                                     \
+  RealtimeChecker::ScopedRealtimeSection JUCE_JOIN_MACRO(rtSection_, __LINE__)
+#define SAMPLER_RT_ALLOW_LOCK()                                                \
+  RealtimeChecker::ScopedLockAllowance JUCE_JOIN_MACRO(rtAllowance_, __LINE__)
+
+#else
+
+#define SAMPLER_RT_SCOPE()
+#define SAMPLER_RT_ALLOW_LOCK()
+
+#endif
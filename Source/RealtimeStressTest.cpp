@@ -0,0 +1,137 @@
+#include "RealtimeStressTest.h"
+#include "RealtimeChecks.h"
+#include <cmath>
+#include <iostream>
+
+namespace {
+// Noise bursts on a fixed grid, so the analysis finds plenty of slices
+std::shared_ptr<juce::AudioBuffer<float>> makeStressSample(double sampleRate) {
+  constexpr double seconds = 8.0, burstsPerSecond = 6.0;
+  const int numSamples = (int)(seconds * sampleRate);
+  const int spacing = (int)(sampleRate / burstsPerSecond);
+
+  auto audio = std::make_shared<juce::AudioBuffer<float>>(2, numSamples);
+  juce::Random random(1234);
+
+  for (int i = 0; i < numSamples; ++i) {
+    const float envelope =
+        std::exp(-(float)(i % spacing) / (float)(0.02 * sampleRate));
+    const float value = envelope * (random.nextFloat() * 2.0f - 1.0f) * 0.8f;
+    audio->setSample(0, i, value);
+    audio->setSample(1, i, value);
+  }
+  return audio;
+}
+} // namespace
+
+RealtimeStressTest::RealtimeStressTest(
+    std::function<void(int exitCode)> onFinishedCallback)
+    : onFinished(std::move(onFinishedCallback)) {
+  engine.addChangeListener(this);
+}
+
+RealtimeStressTest::~RealtimeStressTest() {
+  stopTimer();
+  running = false;
+  for (auto &thread : threads)
+    thread.join();
+  engine.removeChangeListener(this);
+}
+
+void RealtimeStressTest::start(double durationSeconds) {
+  duration = durationSeconds;
+#if !SAMPLER_PRO_RT_CHECKS
+  std::cout << "Built without SAMPLER_PRO_RT_CHECKS: the engine is exercised "
+               "but violations cannot be detected\n";
+#endif
+
+  // Analysis can take a while; give up if it never produces slices
+  constexpr int analysisTimeoutMs = 60000;
+  startTimer(analysisTimeoutMs);
+  engine.loadBuffer("Stress", makeStressSample(44100.0), 44100.0);
+}
+
+void RealtimeStressTest::changeListenerCallback(juce::ChangeBroadcaster *) {
+  if (started || engine.getAnalysis().onsets.size() < 2)
+    return;
+
+  started = true;
+#if SAMPLER_PRO_RT_CHECKS
+  RealtimeChecker::getInstance().reset();
+#endif
+
+  engine.prepareToPlay(renderSampleRate, blockSize);
+  running = true;
+  threads.emplace_back([this] { renderLoop(); });
+  for (int i = 0; i < numControlThreads; ++i)
+    threads.emplace_back([this, i] { controlLoop(i + 1); });
+
+  startTimer((int)(duration * 1000.0));
+}
+
+void RealtimeStressTest::timerCallback() {
+  stopTimer();
+  if (!started)
+    std::cout << "Stress sample was never analysed\n";
+  finish();
+}
+
+void RealtimeStressTest::renderLoop() {
+  juce::AudioBuffer<float> buffer(2, blockSize);
+  juce::MidiBuffer midi;
+
+  // As fast as the engine allows; yielding lets the control threads in
+  // between blocks the way a real callback's idle time would
+  while (running.load()) {
+    buffer.clear();
+    engine.processBlock(buffer, midi);
+    ++blocksRendered;
+    std::this_thread::yield();
+  }
+}
+
+void RealtimeStressTest::controlLoop(int seed) {
+  juce::Random random(seed);
+  const int numSlices = (int)engine.getAnalysis().onsets.size();
+
+  while (running.load()) {
+    switch (random.nextInt(4)) {
+    case 0:
+    case 1:
+      engine.playSlice(random.nextInt(numSlices));
+      break;
+    case 2:
+      engine.play();
+      break;
+    default:
+      engine.stop();
+      break;
+    }
+
+    ++controlCalls;
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(random.nextInt(2000)));
+  }
+}
+
+void RealtimeStressTest::finish() {
+  running = false;
+  for (auto &thread : threads)
+    thread.join();
+  threads.clear();
+  if (started)
+    engine.releaseResources();
+
+  std::cout << "Rendered " << blocksRendered.load() << " blocks against "
+            << controlCalls.load() << " control calls\n";
+
+  int exitCode = started ? 0 : 1;
+#if SAMPLER_PRO_RT_CHECKS
+  const auto &checker = RealtimeChecker::getInstance();
+  std::cout << checker.createReport() << std::flush;
+  if (checker.getTotalCount() > 0)
+    exitCode = 1;
+#endif
+
+  onFinished(exitCode);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "AudioEngine.h"
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Headless run behind the --rt-stress command line option. A synthetic
+// sample is loaded into an AudioEngine, whose processBlock is then driven
+// flat out from a stand-in audio thread while control threads hammer
+// playSlice/play/stop. Finishes with the real-time checker's report and an
+// exit code of 1 if anything was flagged on the audio thread. The control
+// threads share the transport's locks with it by design, so contention on
+// those is reported but does not fail the run. Without
+// SAMPLER_PRO_RT_CHECKS it still exercises the engine, but cannot flag.
+class RealtimeStressTest : private juce::ChangeListener, private juce::Timer {
+public:
+  explicit RealtimeStressTest(std::function<void(int exitCode)> onFinished);
+  ~RealtimeStressTest() override;
+
+  void start(double durationSeconds);
+
+private:
+  static constexpr double renderSampleRate = 48000.0;
+  static constexpr int blockSize = 256;
+  static constexpr int numControlThreads = 3;
+
+  void changeListenerCallback(juce::ChangeBroadcaster *) override;
+  void timerCallback() override;
+  void renderLoop();
+  void controlLoop(int seed);
+  void finish();
+
+  AudioEngine engine;
+  std::function<void(int)> onFinished;
+  double duration = 10.0;
+  bool started = false;
+
+  std::atomic<bool> running{false};
+  std::atomic<juce::int64> blocksRendered{0};
+  std::atomic<juce::int64> controlCalls{0};
+  std::vector<std::thread> threads;
+
+  JUCE_DECLARE_NON_COPYABLE(RealtimeStressTest)
+};
@@ -0,0 +1,117 @@
+#include "RenderProfiler.h"
+#include <cmath>
+
+void RenderProfiler::prepare(double sampleRate, int samplesPerBlock) {
+  currentSampleRate.store(sampleRate > 0 ? sampleRate : 44100.0,
+                          std::memory_order_relaxed);
+  blockDurationSeconds.store(samplesPerBlock / currentSampleRate.load(),
+                             std::memory_order_relaxed);
+  lastStartTicks = 0;
+  reset();
+}
+
+void RenderProfiler::clearCounters() {
+  blocks.store(0, std::memory_order_relaxed);
+  overruns.store(0, std::memory_order_relaxed);
+  lateCallbacks.store(0, std::memory_order_relaxed);
+  averageLoad.store(0.0, std::memory_order_relaxed);
+  peakLoad.store(0.0, std::memory_order_relaxed);
+  worstRenderSeconds.store(0.0, std::memory_order_relaxed);
+  for (auto &bucket : histogram)
+    bucket.store(0, std::memory_order_relaxed);
+}
+
+void RenderProfiler::addBlock(juce::int64 startTicks, int numSamples) {
+  const juce::int64 endTicks = juce::Time::getHighResolutionTicks();
+
+  if (resetRequested.exchange(false, std::memory_order_relaxed)) {
+    clearCounters();
+    lastStartTicks = 0;
+  }
+
+  if (numSamples <= 0)
+    return;
+
+  const double sampleRate = currentSampleRate.load(std::memory_order_relaxed);
+  const double blockSeconds = numSamples / sampleRate;
+  const double renderSeconds =
+      juce::Time::highResolutionTicksToSeconds(endTicks - startTicks);
+  const double load = renderSeconds / blockSeconds;
+
+  blockDurationSeconds.store(blockSeconds, std::memory_order_relaxed);
+
+  // A callback arriving much later than one block after the previous one
+  // means the device ran dry, even if our own render was fast enough
+  if (lastStartTicks != 0) {
+    const double gap =
+        juce::Time::highResolutionTicksToSeconds(startTicks - lastStartTicks);
+    if (gap > blockSeconds * lateFactor)
+      lateCallbacks.fetch_add(1, std::memory_order_relaxed);
+  }
+  lastStartTicks = startTicks;
+
+  if (load >= spikeLoad)
+    overruns.fetch_add(1, std::memory_order_relaxed);
+
+  const int bucket = juce::jlimit(
+      0, numBuckets - 1, (int)(load / maxLoad * (double)numBuckets));
+  histogram[(size_t)bucket].fetch_add(1, std::memory_order_relaxed);
+
+  // Single writer, so plain load/store is enough for the running maxima
+  if (load > peakLoad.load(std::memory_order_relaxed))
+    peakLoad.store(load, std::memory_order_relaxed);
+  if (renderSeconds > worstRenderSeconds.load(std::memory_order_relaxed))
+    worstRenderSeconds.store(renderSeconds, std::memory_order_relaxed);
+
+  const double previous = averageLoad.load(std::memory_order_relaxed);
+  averageLoad.store(previous + (load - previous) * 0.05,
+                    std::memory_order_relaxed);
+
+  blocks.fetch_add(1, std::memory_order_relaxed);
+}
+
+RenderProfiler::Snapshot RenderProfiler::getSnapshot() const {
+  Snapshot snapshot;
+  snapshot.blocks = blocks.load(std::memory_order_relaxed);
+  snapshot.overruns = overruns.load(std::memory_order_relaxed);
+  snapshot.lateCallbacks = lateCallbacks.load(std::memory_order_relaxed);
+  snapshot.averageLoad = averageLoad.load(std::memory_order_relaxed);
+  snapshot.peakLoad = peakLoad.load(std::memory_order_relaxed);
+  snapshot.worstRenderMs =
+      worstRenderSeconds.load(std::memory_order_relaxed) * 1000.0;
+  snapshot.blockDurationMs =
+      blockDurationSeconds.load(std::memory_order_relaxed) * 1000.0;
+
+  for (int i = 0; i < numBuckets; ++i)
+    snapshot.histogram[(size_t)i] =
+        histogram[(size_t)i].load(std::memory_order_relaxed);
+
+  return snapshot;
+}
+
+juce::String RenderProfiler::createReport() const {
+  auto snapshot = getSnapshot();
+  juce::String report;
+
+  report << "blocks," << snapshot.blocks << "\n"
+         << "block_ms," << juce::String(snapshot.blockDurationMs, 3) << "\n"
+         << "average_load," << juce::String(snapshot.averageLoad, 4) << "\n"
+         << "peak_load," << juce::String(snapshot.peakLoad, 4) << "\n"
+         << "worst_render_ms," << juce::String(snapshot.worstRenderMs, 3)
+         << "\n"
+         << "overruns," << snapshot.overruns << "\n"
+         << "late_callbacks," << snapshot.lateCallbacks << "\n"
+         << "\n"
+         << "load_from,load_to,blocks\n";
+
+  for (int i = 0; i < numBuckets; ++i) {
+    const double from = maxLoad * i / numBuckets;
+    const double to = maxLoad * (i + 1) / numBuckets;
+    report << juce::String(from, 2) << ","
+           << (i == numBuckets - 1 ? juce::String("inf")
+                                   : juce::String(to, 2))
+           << "," << (int)snapshot.histogram[(size_t)i] << "\n";
+  }
+
+  return report;
+}
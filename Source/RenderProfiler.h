@@ -0,0 +1,71 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <atomic>
+
+// Measures how long each audio block takes to render relative to its
+// deadline. The audio thread is the only writer; every field is a relaxed
+// atomic so the UI can read snapshots at any time without locking.
+class RenderProfiler {
+public:
+  static constexpr int numBuckets = 40;     // Histogram of CPU load
+  static constexpr double maxLoad = 2.0;    // Last bucket collects >= 200%
+  static constexpr double spikeLoad = 1.0;  // Over budget: block was late
+  static constexpr double lateFactor = 2.0; // Gap between callbacks
+
+  struct Snapshot {
+    juce::int64 blocks = 0;
+    juce::int64 overruns = 0;       // Render time exceeded block duration
+    juce::int64 lateCallbacks = 0;  // Device called back too late
+    double averageLoad = 0.0;       // Smoothed load, 1.0 == 100%
+    double peakLoad = 0.0;          // Worst single block
+    double worstRenderMs = 0.0;
+    double blockDurationMs = 0.0;
+    std::array<juce::uint32, numBuckets> histogram{};
+
+    juce::int64 getXruns() const { return overruns + lateCallbacks; }
+  };
+
+  class ScopedBlock {
+  public:
+    ScopedBlock(RenderProfiler &p, int samples)
+        : profiler(p), numSamples(samples),
+          startTicks(juce::Time::getHighResolutionTicks()) {}
+    ~ScopedBlock() { profiler.addBlock(startTicks, numSamples); }
+
+  private:
+    RenderProfiler &profiler;
+    int numSamples;
+    juce::int64 startTicks;
+
+    JUCE_DECLARE_NON_COPYABLE(ScopedBlock)
+  };
+
+  void prepare(double sampleRate, int samplesPerBlock);
+  void addBlock(juce::int64 startTicks, int numSamples);
+
+  // Safe from any thread, applied by the audio thread on its next block
+  void reset() { resetRequested.store(true, std::memory_order_relaxed); }
+
+  Snapshot getSnapshot() const;
+  juce::String createReport() const;
+
+private:
+  void clearCounters();
+
+  std::atomic<double> currentSampleRate{44100.0};
+  std::atomic<bool> resetRequested{false};
+
+  std::atomic<juce::int64> blocks{0};
+  std::atomic<juce::int64> overruns{0};
+  std::atomic<juce::int64> lateCallbacks{0};
+  std::atomic<double> averageLoad{0.0};
+  std::atomic<double> peakLoad{0.0};
+  std::atomic<double> worstRenderSeconds{0.0};
+  std::atomic<double> blockDurationSeconds{0.0};
+  std::array<std::atomic<juce::uint32>, numBuckets> histogram{};
+
+  // Audio thread only
+  juce::int64 lastStartTicks = 0;
+};
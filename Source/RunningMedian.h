@@ -0,0 +1,75 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+
+// Sliding-window median over values in [0, maxValue]. Values are counted in
+// a fixed histogram (square-root spaced, so resolution is finest near zero
+// where onset functions spend most of their time) and the median bin is
+// tracked incrementally, so add/remove cost a bounded number of steps
+// regardless of window length.
+class RunningMedian {
+public:
+  static constexpr int numBins = 512;
+
+  void reset(float newMaxValue) {
+    maxValue = newMaxValue > 0.0f ? newMaxValue : 1.0f;
+    counts.fill(0);
+    total = 0;
+    medianBin = 0;
+    below = 0;
+  }
+
+  void add(float value) {
+    const int bin = binFor(value);
+    ++counts[(size_t)bin];
+    ++total;
+    if (bin < medianBin)
+      ++below;
+    rebalance();
+  }
+
+  void remove(float value) {
+    const int bin = binFor(value);
+    --counts[(size_t)bin];
+    --total;
+    if (bin < medianBin)
+      --below;
+    rebalance();
+  }
+
+  float getMedian() const {
+    if (total == 0)
+      return 0.0f;
+    const float position = ((float)medianBin + 0.5f) / (float)numBins;
+    return position * position * maxValue;
+  }
+
+private:
+  int binFor(float value) const {
+    const float position = std::sqrt(juce::jmax(0.0f, value) / maxValue);
+    return juce::jlimit(0, numBins - 1, (int)(position * (float)numBins));
+  }
+
+  // Moves medianBin until it holds the element of rank (total - 1) / 2
+  void rebalance() {
+    if (total == 0) {
+      medianBin = 0;
+      below = 0;
+      return;
+    }
+
+    const int rank = (total - 1) / 2;
+    while (below + counts[(size_t)medianBin] <= rank)
+      below += counts[(size_t)medianBin++];
+    while (below > rank)
+      below -= counts[(size_t)--medianBin];
+  }
+
+  std::array<int, numBins> counts{};
+  int total = 0;
+  int medianBin = 0;
+  int below = 0; // Number of values in bins below medianBin
+  float maxValue = 1.0f;
+};
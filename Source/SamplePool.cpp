@@ -0,0 +1,403 @@
+#include "SamplePool.h"
+#include "Parallel.h"
+#include "Tracing.h"
+#include <limits>
+
+namespace {
+juce::int64 bytesFor(const juce::AudioBuffer<float> &buffer) {
+  return (juce::int64)buffer.getNumChannels() * buffer.getNumSamples() *
+         (juce::int64)sizeof(float);
+}
+} // namespace
+
+SamplePool::SamplePool(juce::AudioFormatManager &formatManagerToUse)
+    : formatManager(formatManagerToUse) {}
+
+void SamplePool::setMemoryBudget(juce::int64 newBudgetBytes) {
+  const juce::ScopedLock sl(lock);
+  memoryBudget = juce::jmax((juce::int64)0, newBudgetBytes);
+  enforceBudget();
+}
+
+juce::int64 SamplePool::getMemoryBudget() const {
+  const juce::ScopedLock sl(lock);
+  return memoryBudget;
+}
+
+juce::int64 SamplePool::getResidentBytes() const {
+  const juce::ScopedLock sl(lock);
+  juce::int64 total = 0;
+  for (auto &entry : entries)
+    if (entry->isResident())
+      total += entry->numBytes;
+  return total;
+}
+
+void SamplePool::setCompactStorage(bool shouldBeCompact) {
+  const juce::ScopedLock sl(lock);
+  compactStorage = shouldBeCompact;
+}
+
+bool SamplePool::isCompactStorage() const {
+  const juce::ScopedLock sl(lock);
+  return compactStorage;
+}
+
+int SamplePool::getNumSamples() const {
+  const juce::ScopedLock sl(lock);
+  return (int)entries.size();
+}
+
+juce::String SamplePool::getName(int index) const {
+  const juce::ScopedLock sl(lock);
+  if (index < 0 || index >= (int)entries.size())
+    return {};
+  return entries[(size_t)index]->name;
+}
+
+juce::File SamplePool::getFile(int index) const {
+  const juce::ScopedLock sl(lock);
+  if (index < 0 || index >= (int)entries.size())
+    return {};
+  return entries[(size_t)index]->file;
+}
+
+int SamplePool::indexOf(const juce::File &file) const {
+  const juce::ScopedLock sl(lock);
+  for (int i = 0; i < (int)entries.size(); ++i)
+    if (entries[(size_t)i]->file == file)
+      return i;
+  return -1;
+}
+
+bool SamplePool::isResident(int index) const {
+  const juce::ScopedLock sl(lock);
+  if (index < 0 || index >= (int)entries.size())
+    return false;
+  return entries[(size_t)index]->isResident();
+}
+
+bool SamplePool::hasFailed(int index) const {
+  const juce::ScopedLock sl(lock);
+  if (index < 0 || index >= (int)entries.size())
+    return false;
+  return entries[(size_t)index]->failed;
+}
+
+int SamplePool::loadFiles(const juce::Array<juce::File> &files,
+                          const AudioAnalysis::Options &options,
+                          const std::function<bool()> &shouldCancel) {
+  SAMPLER_TRACE_SCOPE("loadFiles", files.size());
+
+  // Reserve slots up front so the pool order matches the order given, no
+  // matter which file finishes decoding first. Only files a reader accepts
+  // get a slot, and slots are never removed, so indices stay stable; a slot
+  // whose earlier load failed is loaded again in place.
+  std::vector<Entry *> pending((size_t)files.size(), nullptr);
+  int firstIndex = -1;
+  bool compact;
+
+  // Headers are read before taking the lock: some readers (MP3) scan the
+  // whole file for its length, and the message thread polls the pool
+  std::vector<double> readerSampleRates((size_t)files.size(), 0.0);
+  for (int i = 0; i < files.size(); ++i) {
+    if (indexOf(files[i]) >= 0)
+      continue;
+    std::unique_ptr<juce::AudioFormatReader> reader(
+        formatManager.createReaderFor(files[i]));
+    if (reader != nullptr)
+      readerSampleRates[(size_t)i] = reader->sampleRate;
+  }
+
+  {
+    const juce::ScopedLock sl(lock);
+    compact = compactStorage;
+    for (int i = 0; i < files.size(); ++i) {
+      int index = -1;
+      for (int e = 0; e < (int)entries.size() && index < 0; ++e)
+        if (entries[(size_t)e]->file == files[i])
+          index = e;
+
+      if (index >= 0 && entries[(size_t)index]->failed) {
+        auto &entry = *entries[(size_t)index];
+        entry.failed = false;
+        pending[(size_t)i] = &entry;
+      } else if (index < 0) {
+        if (readerSampleRates[(size_t)i] <= 0.0)
+          continue;
+
+        auto entry = std::make_unique<Entry>();
+        entry->name = files[i].getFileName();
+        entry->file = files[i];
+        entry->sampleRate = readerSampleRates[(size_t)i];
+        pending[(size_t)i] = entry.get();
+        index = (int)entries.size();
+        entries.push_back(std::move(entry));
+      }
+
+      if (firstIndex < 0)
+        firstIndex = index;
+    }
+  }
+
+  // One workspace per worker that picks up a file, owned by this batch and
+  // freed when it ends, so scratch sized for the longest file is not left
+  // behind on the pool threads. While the batch runs each one adds about
+  // 2.5% of its longest file's length as mono float on top of the budget.
+  std::vector<std::unique_ptr<AnalysisWorkspace>> workspaces(
+      (size_t)ParallelPool::getInstance().getNumWorkers());
+
+  // Inner parallelFor calls (peaks, analysis) run inline on whichever worker
+  // owns the file, so the pool is kept busy with whole files instead
+  parallelFor(files.size(), [&](int i, int worker) {
+    Entry *entry = pending[(size_t)i];
+    if (entry == nullptr)
+      return;
+
+    // Otherwise the slot would wait for audio that is never coming
+    auto markFailed = [&] {
+      const juce::ScopedLock sl(lock);
+      entry->failed = true;
+    };
+
+    if (shouldCancel && shouldCancel()) {
+      markFailed();
+      return;
+    }
+
+    auto audio = std::make_shared<juce::AudioBuffer<float>>();
+    double sampleRate = 0.0;
+    std::optional<PackedAudioBuffer::Format> packFormat;
+    if (!decode(files[i], *audio, sampleRate, packFormat)) {
+      markFailed();
+      return;
+    }
+
+    // Peaks and analysis run on the float samples before they are packed
+    auto peaks = std::make_shared<WaveformPeaks>();
+    peaks->build(*audio, sampleRate);
+    auto &workspace = workspaces[(size_t)worker];
+    if (workspace == nullptr)
+      workspace = std::make_unique<AnalysisWorkspace>();
+    AudioAnalysis::AnalysisResults analysis;
+    AudioAnalysis::analyze(*audio, sampleRate, options, *workspace, analysis);
+
+    std::shared_ptr<const PackedAudioBuffer> packed;
+    if (compact && packFormat.has_value()) {
+      packed = std::make_shared<PackedAudioBuffer>(*audio, *packFormat);
+      audio.reset();
+    }
+
+    const juce::ScopedLock sl(lock);
+    entry->sampleRate = sampleRate;
+    setAudio(*entry, std::move(audio), std::move(packed));
+    entry->peaks = std::move(peaks);
+    entry->analysis = std::move(analysis);
+    entry->lastUsed = ++useCounter;
+    entry->ready = true;
+    enforceBudget();
+  });
+
+  return firstIndex;
+}
+
+int SamplePool::addBuffer(const juce::String &name,
+                          std::shared_ptr<juce::AudioBuffer<float>> audio,
+                          double sampleRate,
+                          std::shared_ptr<const WaveformPeaks> peaks,
+                          const AudioAnalysis::AnalysisResults &analysis) {
+  auto entry = std::make_unique<Entry>();
+  entry->name = name;
+  entry->sampleRate = sampleRate;
+  entry->peaks = std::move(peaks);
+  entry->analysis = analysis;
+  entry->ready = true;
+
+  const juce::ScopedLock sl(lock);
+  setAudio(*entry, std::move(audio), nullptr);
+  entry->lastUsed = ++useCounter;
+  entries.push_back(std::move(entry));
+  enforceBudget();
+  return (int)entries.size() - 1;
+}
+
+int SamplePool::addFile(const juce::File &file, double sampleRate,
+                        std::shared_ptr<const WaveformPeaks> peaks,
+                        const AudioAnalysis::AnalysisResults &analysis) {
+  const juce::ScopedLock sl(lock);
+  for (int i = 0; i < (int)entries.size(); ++i) {
+    auto &entry = *entries[(size_t)i];
+    if (entry.failed && entry.file == file) {
+      entry.sampleRate = sampleRate;
+      entry.peaks = std::move(peaks);
+      entry.analysis = analysis;
+      entry.lastUsed = ++useCounter;
+      entry.failed = false;
+      entry.ready = true;
+      return i;
+    }
+  }
+
+  auto entry = std::make_unique<Entry>();
+  entry->name = file.getFileName();
+  entry->file = file;
+  entry->sampleRate = sampleRate;
+  entry->peaks = std::move(peaks);
+  entry->analysis = analysis;
+  entry->ready = true;
+  entry->lastUsed = ++useCounter;
+  entries.push_back(std::move(entry));
+  return (int)entries.size() - 1;
+}
+
+bool SamplePool::acquire(int index, Sample &destination,
+                         bool decodeIfEvicted) {
+  juce::File reloadFrom;
+  bool compact;
+  {
+    const juce::ScopedLock sl(lock);
+    compact = compactStorage;
+    if (index < 0 || index >= (int)entries.size())
+      return false;
+
+    auto &entry = *entries[(size_t)index];
+    if (!entry.ready)
+      return false;
+
+    entry.lastUsed = ++useCounter;
+    if (!entry.isResident() && decodeIfEvicted)
+      reloadFrom = entry.file;
+  }
+
+  // Decode outside the lock so a batch load is not held up meanwhile
+  if (reloadFrom != juce::File()) {
+    SAMPLER_TRACE_SCOPE("reloadEvicted", reloadFrom.getSize());
+    auto audio = std::make_shared<juce::AudioBuffer<float>>();
+    double sampleRate = 0.0;
+    std::optional<PackedAudioBuffer::Format> packFormat;
+    if (!decode(reloadFrom, *audio, sampleRate, packFormat))
+      return false;
+
+    std::shared_ptr<const PackedAudioBuffer> packed;
+    if (compact && packFormat.has_value()) {
+      packed = std::make_shared<PackedAudioBuffer>(*audio, *packFormat);
+      audio.reset();
+    }
+
+    const juce::ScopedLock sl(lock);
+    auto &entry = *entries[(size_t)index];
+    if (!entry.isResident())
+      setAudio(entry, std::move(audio), std::move(packed));
+  }
+
+  const juce::ScopedLock sl(lock);
+  auto &entry = *entries[(size_t)index];
+  destination.name = entry.name;
+  destination.file = entry.file;
+  destination.sampleRate = entry.sampleRate;
+  destination.audio = entry.audio;
+  destination.packed = entry.packed;
+  destination.peaks = entry.peaks;
+  destination.analysis = entry.analysis;
+
+  // Evict others now that the caller holds a reference to this one
+  enforceBudget();
+  return !decodeIfEvicted || destination.audio != nullptr ||
+         destination.packed != nullptr;
+}
+
+void SamplePool::copyViewedPeaks() {
+  const juce::ScopedLock sl(lock);
+  for (auto &entry : entries) {
+    if (entry->peaks != nullptr && entry->peaks->isView()) {
+      auto owned = std::make_shared<WaveformPeaks>();
+      owned->copyFrom(*entry->peaks);
+      entry->peaks = std::move(owned);
+    }
+  }
+}
+
+void SamplePool::setPeaks(int index,
+                          std::shared_ptr<const WaveformPeaks> peaks) {
+  const juce::ScopedLock sl(lock);
+  if (index >= 0 && index < (int)entries.size())
+    entries[(size_t)index]->peaks = std::move(peaks);
+}
+
+AudioAnalysis::AnalysisResults SamplePool::getAnalysis(int index) const {
+  const juce::ScopedLock sl(lock);
+  if (index < 0 || index >= (int)entries.size())
+    return {};
+  return entries[(size_t)index]->analysis;
+}
+
+void SamplePool::setAnalysis(int index,
+                             const AudioAnalysis::AnalysisResults &analysis) {
+  const juce::ScopedLock sl(lock);
+  if (index >= 0 && index < (int)entries.size())
+    entries[(size_t)index]->analysis = analysis;
+}
+
+bool SamplePool::decode(
+    const juce::File &file, juce::AudioBuffer<float> &destination,
+    double &sampleRate,
+    std::optional<PackedAudioBuffer::Format> &packFormat) const {
+  std::unique_ptr<juce::AudioFormatReader> reader(
+      formatManager.createReaderFor(file));
+  if (reader == nullptr || reader->lengthInSamples <= 0)
+    return false;
+
+  SAMPLER_TRACE_SCOPE("decode", reader->lengthInSamples);
+  sampleRate = reader->sampleRate;
+
+  // Lossy formats decode to float, and 32-bit data would lose precision
+  packFormat.reset();
+  if (!reader->usesFloatingPointData && reader->bitsPerSample <= 16)
+    packFormat = PackedAudioBuffer::Format::int16;
+  else if (!reader->usesFloatingPointData && reader->bitsPerSample <= 24)
+    packFormat = PackedAudioBuffer::Format::int24;
+
+  destination.setSize((int)reader->numChannels, (int)reader->lengthInSamples);
+  reader->read(&destination, 0, (int)reader->lengthInSamples, 0, true, true);
+  return true;
+}
+
+void SamplePool::setAudio(Entry &entry,
+                          std::shared_ptr<juce::AudioBuffer<float>> audio,
+                          std::shared_ptr<const PackedAudioBuffer> packed) {
+  entry.numBytes = packed != nullptr  ? packed->getSizeInBytes()
+                   : audio != nullptr ? bytesFor(*audio)
+                                      : 0;
+  entry.audio = std::move(audio);
+  entry.packed = std::move(packed);
+}
+
+void SamplePool::enforceBudget() {
+  juce::int64 resident = 0;
+  for (auto &entry : entries)
+    if (entry->isResident())
+      resident += entry->numBytes;
+
+  while (resident > memoryBudget) {
+    // Least recently used audio that can be decoded again and that nobody
+    // (engine, export, analysis) is still holding on to
+    Entry *victim = nullptr;
+    auto oldest = std::numeric_limits<juce::uint64>::max();
+    for (auto &entry : entries) {
+      if (!entry->isResident() || entry->file == juce::File() ||
+          entry->isInUse())
+        continue;
+      if (entry->lastUsed < oldest) {
+        oldest = entry->lastUsed;
+        victim = entry.get();
+      }
+    }
+
+    if (victim == nullptr)
+      break;
+
+    resident -= victim->numBytes;
+    victim->audio.reset();
+    victim->packed.reset();
+  }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "AudioAnalysis.h"
+#include "PackedAudio.h"
+#include "WaveformPeaks.h"
+#include <JuceHeader.h>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+// Every sample the user has loaded, kept switchable without touching the
+// disk. Analysis and waveform peaks stay resident for the lifetime of the
+// pool; decoded audio is evicted least-recently-used first whenever the
+// total exceeds the memory budget, and transparently re-decoded on the
+// next acquire(). In compact mode 16- and 24-bit files are held in their
+// packed PCM form rather than as float. All methods are thread-safe.
+class SamplePool {
+public:
+  struct Sample {
+    juce::String name;
+    juce::File file; // Empty for recordings
+    double sampleRate = 44100.0;
+    // Exactly one of these holds the audio
+    std::shared_ptr<juce::AudioBuffer<float>> audio;
+    std::shared_ptr<const PackedAudioBuffer> packed;
+    std::shared_ptr<const WaveformPeaks> peaks;
+    AudioAnalysis::AnalysisResults analysis;
+  };
+
+  explicit SamplePool(juce::AudioFormatManager &formatManagerToUse);
+
+  void setMemoryBudget(juce::int64 newBudgetBytes);
+  juce::int64 getMemoryBudget() const;
+  juce::int64 getResidentBytes() const;
+
+  // Applies to files decoded from now on, including evicted ones coming back
+  void setCompactStorage(bool shouldBeCompact);
+  bool isCompactStorage() const;
+
+  int getNumSamples() const;
+  juce::String getName(int index) const;
+  juce::File getFile(int index) const;
+  int indexOf(const juce::File &file) const; // -1 if not pooled
+  bool isResident(int index) const;
+  // Cancelled before it decoded, or unreadable. It keeps its slot, so
+  // indices stay stable, but holds no audio and cannot be acquired until
+  // loadFiles() or addFile() is given the same file again.
+  bool hasFailed(int index) const;
+
+  // Decodes, analyses and builds peaks for every file concurrently on the
+  // ParallelPool. Files already in the pool are not loaded again, except
+  // ones that failed before. Returns the pool index of the first file, or -1
+  // if none could be loaded.
+  int loadFiles(const juce::Array<juce::File> &files,
+                const AudioAnalysis::Options &options,
+                const std::function<bool()> &shouldCancel);
+
+  // Adds audio that has no file behind it; it is never evicted
+  int addBuffer(const juce::String &name,
+                std::shared_ptr<juce::AudioBuffer<float>> audio,
+                double sampleRate, std::shared_ptr<const WaveformPeaks> peaks,
+                const AudioAnalysis::AnalysisResults &analysis);
+
+  // Adds a file whose peaks and analysis are already known, such as one
+  // restored from a session. It starts out evicted: the audio is decoded on
+  // the first acquire(). Takes over the slot of a failed load of the file.
+  int addFile(const juce::File &file, double sampleRate,
+              std::shared_ptr<const WaveformPeaks> peaks,
+              const AudioAnalysis::AnalysisResults &analysis);
+
+  // Fills destination and marks the sample most recently used. Evicted audio
+  // is decoded again here, which is the only time a pooled sample reads disk.
+  // Without decodeIfEvicted, an evicted sample fills everything but the
+  // audio and still returns true, so the caller can decode it elsewhere.
+  bool acquire(int index, Sample &destination, bool decodeIfEvicted = true);
+
+  // Replaces peaks that view memory held elsewhere, such as a mapped
+  // session, with owned copies so that memory can be released
+  void copyViewedPeaks();
+
+  void setPeaks(int index, std::shared_ptr<const WaveformPeaks> peaks);
+
+  AudioAnalysis::AnalysisResults getAnalysis(int index) const;
+  void setAnalysis(int index, const AudioAnalysis::AnalysisResults &analysis);
+
+private:
+  struct Entry {
+    juce::String name;
+    juce::File file;
+    double sampleRate = 44100.0;
+    juce::int64 numBytes = 0;
+    bool ready = false;  // False while its batch is still loading
+    bool failed = false; // Never ready; see hasFailed()
+    std::shared_ptr<juce::AudioBuffer<float>> audio;
+    std::shared_ptr<const PackedAudioBuffer> packed;
+    std::shared_ptr<const WaveformPeaks> peaks;
+    AudioAnalysis::AnalysisResults analysis;
+    juce::uint64 lastUsed = 0;
+
+    bool isResident() const { return audio != nullptr || packed != nullptr; }
+    bool isInUse() const {
+      return audio.use_count() > 1 || packed.use_count() > 1;
+    }
+  };
+
+  // packFormat is set for integer PCM that a PackedAudioBuffer can hold
+  bool decode(const juce::File &file, juce::AudioBuffer<float> &destination,
+              double &sampleRate,
+              std::optional<PackedAudioBuffer::Format> &packFormat) const;
+  void setAudio(Entry &entry, std::shared_ptr<juce::AudioBuffer<float>> audio,
+                std::shared_ptr<const PackedAudioBuffer> packed); // Lock held
+  void enforceBudget(); // Caller holds lock
+
+  juce::AudioFormatManager &formatManager;
+
+  mutable juce::CriticalSection lock;
+  std::vector<std::unique_ptr<Entry>> entries;
+  juce::int64 memoryBudget = (juce::int64)1024 * 1024 * 1024;
+  juce::uint64 useCounter = 0;
+  bool compactStorage = false;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SamplePool)
+};
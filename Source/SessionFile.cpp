@@ -0,0 +1,238 @@
+#include "SessionFile.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace {
+juce::uint64 alignTo16(juce::uint64 offset) { return (offset + 15) & ~15ull; }
+} // namespace
+
+size_t SessionFile::getSliceColumnBytes(int column, juce::uint64 numSlices) {
+  const size_t perSlice = column == numSliceColumns - 1
+                              ? AudioAnalysis::fingerprintSize
+                              : 1;
+  return sizeof(float) * perSlice * (size_t)numSlices;
+}
+
+bool SessionFile::write(const Contents &contents, juce::OutputStream &out) {
+  static_assert(sizeof(int) == sizeof(float), "slice columns are 4 bytes");
+
+  const auto &analysis = contents.analysis;
+  const auto &slices = analysis.slices;
+  const auto *peaks = contents.peaks.get();
+  const juce::String path = contents.source.getFullPathName();
+
+  // Sample positions are widened so the format outlives 32-bit lengths
+  const std::vector<juce::int64> onsets(analysis.onsets.begin(),
+                                        analysis.onsets.end());
+  const auto numBeats =
+      std::min(analysis.beats.size(), analysis.beatTempos.size());
+  const std::vector<juce::int64> beats(analysis.beats.begin(),
+                                       analysis.beats.begin() + numBeats);
+
+  Header header{};
+  header.magic = magic;
+  header.version = version;
+  header.numSlices = (juce::uint32)slices.size();
+  header.fingerprintSize = (juce::uint32)AudioAnalysis::fingerprintSize;
+  header.sampleRate = contents.sampleRate;
+  header.bpm = analysis.bpm;
+  header.frequency = analysis.frequency;
+  header.zoom = contents.zoom;
+  header.numOnsets = onsets.size();
+  header.numBeats = beats.size();
+  if (peaks != nullptr) {
+    header.numChannels = (juce::uint32)peaks->getNumChannels();
+    header.numSamples = peaks->getNumSamples();
+    header.peakDataSize = peaks->getDataSize();
+  }
+
+  // Every array starts 16-byte aligned so it can be used in place once mapped
+  juce::uint64 offset = alignTo16(sizeof(Header));
+  auto place = [&offset](juce::uint64 &field, size_t bytes) {
+    field = offset;
+    offset = alignTo16(offset + bytes);
+  };
+  header.pathSize = path.getNumBytesAsUTF8();
+  place(header.pathOffset, header.pathSize);
+  place(header.onsetOffset, sizeof(juce::int64) * onsets.size());
+  place(header.beatOffset, sizeof(juce::int64) * beats.size());
+  place(header.beatTempoOffset, sizeof(double) * beats.size());
+
+  const void *sliceColumns[numSliceColumns] = {
+      slices.start.data(),    slices.length.data(), slices.duration.data(),
+      slices.pitch.data(),    slices.rms.data(),    slices.loudness.data(),
+      slices.peak.data(),     slices.centroid.data(),
+      slices.fingerprint.data()};
+  juce::uint64 columnOffsets[numSliceColumns];
+  for (int column = 0; column < numSliceColumns; ++column)
+    place(columnOffsets[column],
+          getSliceColumnBytes(column, header.numSlices));
+  header.sliceOffset = columnOffsets[0];
+
+  place(header.minimumOffset, sizeof(float) * header.peakDataSize);
+  place(header.maximumOffset, sizeof(float) * header.peakDataSize);
+
+  const auto base = out.getPosition();
+  auto writeAt = [&out, base](juce::uint64 position, const void *data,
+                              size_t bytes) {
+    while ((juce::uint64)(out.getPosition() - base) < position)
+      out.writeByte(0);
+    return bytes == 0 || out.write(data, bytes);
+  };
+
+  bool ok = writeAt(0, &header, sizeof(Header));
+  ok = ok && writeAt(header.pathOffset, path.toRawUTF8(), header.pathSize);
+  ok = ok && writeAt(header.onsetOffset, onsets.data(),
+                     sizeof(juce::int64) * onsets.size());
+  ok = ok && writeAt(header.beatOffset, beats.data(),
+                     sizeof(juce::int64) * beats.size());
+  ok = ok && writeAt(header.beatTempoOffset, analysis.beatTempos.data(),
+                     sizeof(double) * beats.size());
+  for (int column = 0; column < numSliceColumns; ++column)
+    ok = ok && writeAt(columnOffsets[column], sliceColumns[column],
+                       getSliceColumnBytes(column, header.numSlices));
+  if (peaks != nullptr) {
+    ok = ok && writeAt(header.minimumOffset, peaks->getMinimumData(),
+                       sizeof(float) * header.peakDataSize);
+    ok = ok && writeAt(header.maximumOffset, peaks->getMaximumData(),
+                       sizeof(float) * header.peakDataSize);
+  }
+  return ok && writeAt(offset, nullptr, 0);
+}
+
+bool SessionFile::save(const Contents &contents, const juce::File &file) {
+  file.getParentDirectory().createDirectory();
+
+  juce::TemporaryFile temp(file);
+  {
+    juce::FileOutputStream out(temp.getFile());
+    if (!out.openedOk())
+      return false;
+
+    const bool ok = write(contents, out);
+    out.flush();
+    if (!ok || out.getStatus().failed())
+      return false;
+  }
+
+  return temp.overwriteTargetFileWithTemporary();
+}
+
+bool SessionFile::read(const void *data, size_t size,
+                       std::shared_ptr<const void> owner, Contents &contents) {
+  const auto *base = static_cast<const char *>(data);
+  if (base == nullptr || size < sizeof(Header))
+    return false;
+
+  Header header;
+  std::memcpy(&header, base, sizeof(Header));
+  if (header.magic != magic || header.version != version ||
+      header.fingerprintSize != (juce::uint32)AudioAnalysis::fingerprintSize)
+    return false;
+
+  // Every element is at least four bytes, so larger counts cannot fit and
+  // would only overflow the byte sizes below
+  if (header.numOnsets > size || header.numBeats > size ||
+      header.peakDataSize > size || header.numChannels > size ||
+      header.numSamples < 0 ||
+      (juce::uint64)header.numSamples / WaveformPeaks::samplesPerPeak > size)
+    return false;
+
+  auto inBounds = [size](juce::uint64 offset, juce::uint64 bytes) {
+    return offset % 16 == 0 && offset <= size && bytes <= size - offset;
+  };
+
+  // Column offsets are implied by the first one
+  juce::uint64 columnOffsets[numSliceColumns];
+  columnOffsets[0] = header.sliceOffset;
+  for (int column = 1; column < numSliceColumns; ++column)
+    columnOffsets[column] =
+        alignTo16(columnOffsets[column - 1] +
+                  getSliceColumnBytes(column - 1, header.numSlices));
+
+  bool valid =
+      inBounds(header.pathOffset, header.pathSize) &&
+      inBounds(header.onsetOffset, sizeof(juce::int64) * header.numOnsets) &&
+      inBounds(header.beatOffset, sizeof(juce::int64) * header.numBeats) &&
+      inBounds(header.beatTempoOffset, sizeof(double) * header.numBeats) &&
+      inBounds(header.minimumOffset, sizeof(float) * header.peakDataSize) &&
+      inBounds(header.maximumOffset, sizeof(float) * header.peakDataSize);
+  for (int column = 0; column < numSliceColumns; ++column)
+    valid = valid && inBounds(columnOffsets[column],
+                              getSliceColumnBytes(column, header.numSlices));
+  if (!valid || !(header.sampleRate > 0))
+    return false;
+
+  // The pyramid's shape follows from its length, so a mismatch means the
+  // file is damaged
+  auto peaks = std::make_shared<WaveformPeaks>();
+  peaks->setView(
+      (int)header.numChannels, header.numSamples, header.sampleRate,
+      reinterpret_cast<const float *>(base + header.minimumOffset),
+      reinterpret_cast<const float *>(base + header.maximumOffset),
+      std::move(owner));
+  if (peaks->getDataSize() != header.peakDataSize)
+    return false;
+
+  // Onsets and beats are narrowed to int sample positions, and everything
+  // downstream assumes they are ordered and inside the audio
+  const auto *onsets =
+      reinterpret_cast<const juce::int64 *>(base + header.onsetOffset);
+  const auto *beats =
+      reinterpret_cast<const juce::int64 *>(base + header.beatOffset);
+  auto areValidPositions = [&header](const juce::int64 *positions,
+                                     juce::uint64 count) {
+    for (juce::uint64 i = 0; i < count; ++i)
+      if (positions[i] < (i > 0 ? positions[i - 1] : 0) ||
+          positions[i] > header.numSamples)
+        return false;
+    return true;
+  };
+  if (header.numSamples > std::numeric_limits<int>::max() ||
+      !areValidPositions(onsets, header.numOnsets) ||
+      !areValidPositions(beats, header.numBeats))
+    return false;
+
+  auto &analysis = contents.analysis;
+  analysis.bpm = header.bpm;
+  analysis.frequency = header.frequency;
+  analysis.onsets.assign(onsets, onsets + header.numOnsets);
+  analysis.beats.assign(beats, beats + header.numBeats);
+  const auto *tempos =
+      reinterpret_cast<const double *>(base + header.beatTempoOffset);
+  analysis.beatTempos.assign(tempos, tempos + header.numBeats);
+
+  auto &slices = analysis.slices;
+  slices.resize((int)header.numSlices);
+  void *sliceColumns[numSliceColumns] = {
+      slices.start.data(),    slices.length.data(), slices.duration.data(),
+      slices.pitch.data(),    slices.rms.data(),    slices.loudness.data(),
+      slices.peak.data(),     slices.centroid.data(),
+      slices.fingerprint.data()};
+  for (int column = 0; column < numSliceColumns; ++column)
+    std::memcpy(sliceColumns[column], base + columnOffsets[column],
+                getSliceColumnBytes(column, header.numSlices));
+  for (int i = 0; i < slices.size(); ++i) {
+    const auto start = (juce::int64)slices.start[(size_t)i];
+    const auto length = (juce::int64)slices.length[(size_t)i];
+    if (start < 0 || length < 0 || start + length > header.numSamples)
+      return false;
+  }
+
+  contents.source = juce::File(
+      juce::String::fromUTF8(base + header.pathOffset, (int)header.pathSize));
+  contents.sampleRate = header.sampleRate;
+  contents.zoom = header.zoom;
+  contents.peaks = std::move(peaks);
+  return true;
+}
+
+bool SessionFile::open(const juce::File &file, Contents &contents) {
+  auto mapping = std::make_shared<juce::MemoryMappedFile>(
+      file, juce::MemoryMappedFile::readOnly);
+  const auto *data = mapping->getData();
+  const auto size = mapping->getSize();
+  return read(data, size, std::move(mapping), contents);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "AudioAnalysis.h"
+#include "WaveformPeaks.h"
+#include <JuceHeader.h>
+#include <memory>
+
+// Versioned binary snapshot of one sample's editing state: the source file,
+// hand-edited onsets, tempo, per-slice features, zoom and the waveform peak
+// pyramid. Every array is 16-byte aligned behind a fixed header, so a
+// session is used in place: the pyramid points straight into the mapped
+// file (or state block) and only the small editable tables are copied out.
+class SessionFile {
+public:
+  struct Contents {
+    juce::File source;
+    double sampleRate = 44100.0;
+    double zoom = 1.0;
+    AudioAnalysis::AnalysisResults analysis;
+    std::shared_ptr<const WaveformPeaks> peaks;
+  };
+
+  static bool write(const Contents &contents, juce::OutputStream &out);
+  static bool save(const Contents &contents, const juce::File &file);
+
+  // data must stay valid while owner lives; the peaks hold on to owner
+  static bool read(const void *data, size_t size,
+                   std::shared_ptr<const void> owner, Contents &contents);
+  static bool open(const juce::File &file, Contents &contents);
+
+private:
+  static constexpr juce::uint32 magic = 0x53535053; // "SPSS"
+  static constexpr juce::uint32 version = 2; // 2: short tail frames skipped
+
+  // Slice columns follow each other from sliceOffset, each 16-byte aligned:
+  // start, length, duration, pitch, rms, loudness, peak, centroid, then
+  // fingerprintSize floats per slice
+  static constexpr int numSliceColumns = 9;
+
+  struct Header {
+    juce::uint32 magic, version, numChannels, numSlices, fingerprintSize,
+        reserved;
+    juce::int64 numSamples;
+    double sampleRate, bpm, frequency, zoom;
+    juce::uint64 numOnsets, numBeats, peakDataSize;
+    juce::uint64 pathOffset, pathSize, onsetOffset, beatOffset,
+        beatTempoOffset, sliceOffset, minimumOffset, maximumOffset;
+  };
+
+  static size_t getSliceColumnBytes(int column, juce::uint64 numSlices);
+
+  JUCE_DECLARE_NON_COPYABLE(SessionFile)
+};
@@ -0,0 +1,513 @@
+#include "SimilarityIndex.h"
+#include "Parallel.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+constexpr int maxProbes = 64;
+constexpr int kMeansIterations = 10;
+constexpr int trainingPointsPerList = 64;
+constexpr int assignChunkSize = 1024;
+
+float squaredDistance(const float *a, const float *b) {
+  float sum = 0.0f;
+  for (int d = 0; d < SimilarityIndex::dimensions; ++d) {
+    const float difference = a[d] - b[d];
+    sum += difference * difference;
+  }
+  return sum;
+}
+
+int nearestCentroid(const float *vector, const float *centroids,
+                    int numLists) {
+  int best = 0;
+  float bestDistance = std::numeric_limits<float>::max();
+  for (int list = 0; list < numLists; ++list) {
+    const float distance = squaredDistance(
+        vector, centroids + (size_t)list * SimilarityIndex::dimensions);
+    if (distance < bestDistance) {
+      bestDistance = distance;
+      best = list;
+    }
+  }
+  return best;
+}
+
+juce::uint64 alignTo16(juce::uint64 offset) { return (offset + 15) & ~15ull; }
+} // namespace
+
+int SimilarityIndex::addSource(const juce::String &name) {
+  sourceNames.add(name);
+  return sourceNames.size() - 1;
+}
+
+void SimilarityIndex::add(int source,
+                          const AudioAnalysis::SliceFeatures &slices) {
+  for (int i = 0; i < slices.size(); ++i)
+    add(source, slices.start[(size_t)i], slices.length[(size_t)i],
+        slices.getFingerprint(i));
+}
+
+void SimilarityIndex::add(int source, int start, int length,
+                          const float *fingerprint) {
+  stagedItems.push_back({source, start, length});
+  stagedVectors.insert(stagedVectors.end(), fingerprint,
+                       fingerprint + dimensions);
+}
+
+void SimilarityIndex::build(int requestedLists) {
+  SAMPLER_TRACE_SCOPE("buildSimilarityIndex", (juce::int64)stagedItems.size());
+
+  const int count = (int)stagedItems.size();
+  mappedFile.reset();
+
+  if (count == 0) {
+    ownedVectors.clear();
+    ownedItems.clear();
+    ownedCentroids.clear();
+    ownedListStarts.assign(1, 0);
+    ownedMean.assign((size_t)dimensions, 0.0f);
+    ownedScale.assign((size_t)dimensions, 1.0f);
+    numLists = 0;
+    numTrainedItems = 0;
+    setViewToOwned();
+    return;
+  }
+
+  // 1. Z-score every dimension so no coefficient dominates the distance
+  ownedMean.assign((size_t)dimensions, 0.0f);
+  ownedScale.assign((size_t)dimensions, 1.0f);
+  for (int d = 0; d < dimensions; ++d) {
+    double sum = 0.0, squares = 0.0;
+    for (int i = 0; i < count; ++i) {
+      const double value = stagedVectors[(size_t)i * dimensions + d];
+      sum += value;
+      squares += value * value;
+    }
+    const double average = sum / count;
+    const double deviation =
+        std::sqrt(std::max(0.0, squares / count - average * average));
+    ownedMean[(size_t)d] = (float)average;
+    ownedScale[(size_t)d] = deviation > 1.0e-6 ? (float)deviation : 1.0f;
+  }
+
+  normaliseStaged();
+
+  // 2. Lloyd's k-means on a random sample, seeded for reproducible indices
+  const int lists = juce::jlimit(
+      1, count,
+      requestedLists > 0 ? requestedLists : (int)std::sqrt((double)count));
+  juce::Random random(0x5eed);
+
+  std::vector<int> training;
+  const int numTraining = std::min(count, lists * trainingPointsPerList);
+  training.reserve((size_t)numTraining);
+  if (numTraining == count)
+    for (int i = 0; i < count; ++i)
+      training.push_back(i);
+  else
+    for (int i = 0; i < numTraining; ++i)
+      training.push_back(random.nextInt(count));
+
+  auto trainingVector = [&](int t) {
+    return stagedVectors.data() + (size_t)training[(size_t)t] * dimensions;
+  };
+
+  ownedCentroids.resize((size_t)lists * dimensions);
+  for (int list = 0; list < lists; ++list)
+    std::copy_n(trainingVector(random.nextInt(numTraining)), dimensions,
+                ownedCentroids.data() + (size_t)list * dimensions);
+
+  std::vector<int> assignment((size_t)numTraining);
+  std::vector<double> sums((size_t)lists * dimensions);
+  std::vector<int> sizes((size_t)lists);
+  const int numTrainingChunks =
+      (numTraining + assignChunkSize - 1) / assignChunkSize;
+
+  for (int iteration = 0; iteration < kMeansIterations; ++iteration) {
+    parallelFor(numTrainingChunks, [&](int chunk, int) {
+      const int last = std::min(numTraining, (chunk + 1) * assignChunkSize);
+      for (int t = chunk * assignChunkSize; t < last; ++t)
+        assignment[(size_t)t] =
+            nearestCentroid(trainingVector(t), ownedCentroids.data(), lists);
+    });
+
+    std::fill(sums.begin(), sums.end(), 0.0);
+    std::fill(sizes.begin(), sizes.end(), 0);
+    for (int t = 0; t < numTraining; ++t) {
+      const int list = assignment[(size_t)t];
+      const float *vector = trainingVector(t);
+      for (int d = 0; d < dimensions; ++d)
+        sums[(size_t)list * dimensions + d] += vector[d];
+      ++sizes[(size_t)list];
+    }
+
+    for (int list = 0; list < lists; ++list) {
+      float *centroid = ownedCentroids.data() + (size_t)list * dimensions;
+      if (sizes[(size_t)list] == 0) {
+        // Re-seed empty clusters instead of leaving dead lists
+        std::copy_n(trainingVector(random.nextInt(numTraining)), dimensions,
+                    centroid);
+        continue;
+      }
+      for (int d = 0; d < dimensions; ++d)
+        centroid[d] = (float)(sums[(size_t)list * dimensions + d] /
+                              sizes[(size_t)list]);
+    }
+  }
+
+  // 3. Assign every item, then counting-sort them so each list is contiguous
+  std::vector<int> itemList((size_t)count);
+  parallelFor((count + assignChunkSize - 1) / assignChunkSize,
+              [&](int chunk, int) {
+                const int last = std::min(count, (chunk + 1) * assignChunkSize);
+                for (int i = chunk * assignChunkSize; i < last; ++i)
+                  itemList[(size_t)i] = nearestCentroid(
+                      stagedVectors.data() + (size_t)i * dimensions,
+                      ownedCentroids.data(), lists);
+              });
+
+  ownedListStarts.assign((size_t)lists + 1, 0);
+  for (int list : itemList)
+    ++ownedListStarts[(size_t)list + 1];
+  for (int list = 0; list < lists; ++list)
+    ownedListStarts[(size_t)list + 1] += ownedListStarts[(size_t)list];
+
+  std::vector<juce::uint32> cursor(ownedListStarts.begin(),
+                                   ownedListStarts.end() - 1);
+  ownedVectors.resize((size_t)count * dimensions);
+  ownedItems.resize((size_t)count);
+  for (int i = 0; i < count; ++i) {
+    const auto position = cursor[(size_t)itemList[(size_t)i]]++;
+    std::copy_n(stagedVectors.data() + (size_t)i * dimensions, dimensions,
+                ownedVectors.data() + (size_t)position * dimensions);
+    ownedItems[position] = stagedItems[(size_t)i];
+  }
+
+  stagedVectors = std::vector<float>();
+  stagedItems = std::vector<Item>();
+  numLists = lists;
+  numTrainedItems = count;
+  setViewToOwned();
+}
+
+void SimilarityIndex::build(const SimilarityIndex &previous) {
+  SAMPLER_TRACE_SCOPE("updateSimilarityIndex",
+                      (juce::int64)stagedItems.size());
+
+  if (previous.numLists == 0) {
+    build();
+    return;
+  }
+
+  mappedFile.reset();
+  const int count = (int)stagedItems.size();
+  const int lists = previous.numLists;
+
+  // Sources staged here replace the ones of the same name in previous
+  std::vector<int> sourceMap((size_t)previous.getNumSources(), -1);
+  for (int source = 0; source < previous.getNumSources(); ++source)
+    if (!sourceNames.contains(previous.getSourceName(source)))
+      sourceMap[(size_t)source] = addSource(previous.getSourceName(source));
+
+  ownedMean.assign(previous.mean, previous.mean + dimensions);
+  ownedScale.assign(previous.scale, previous.scale + dimensions);
+  ownedCentroids.assign(previous.centroids,
+                        previous.centroids + (size_t)lists * dimensions);
+  normaliseStaged();
+
+  std::vector<int> itemList((size_t)count);
+  parallelFor((count + assignChunkSize - 1) / assignChunkSize,
+              [&](int chunk, int) {
+                const int last = std::min(count, (chunk + 1) * assignChunkSize);
+                for (int i = chunk * assignChunkSize; i < last; ++i)
+                  itemList[(size_t)i] = nearestCentroid(
+                      stagedVectors.data() + (size_t)i * dimensions,
+                      ownedCentroids.data(), lists);
+              });
+
+  // Carried items keep their list; each list gets them first, then the
+  // staged ones assigned to it
+  ownedListStarts.assign((size_t)lists + 1, 0);
+  for (int list = 0; list < lists; ++list)
+    for (auto i = previous.listStarts[list]; i < previous.listStarts[list + 1];
+         ++i)
+      if (sourceMap[(size_t)previous.items[i].source] >= 0)
+        ++ownedListStarts[(size_t)list + 1];
+  for (int list : itemList)
+    ++ownedListStarts[(size_t)list + 1];
+  for (int list = 0; list < lists; ++list)
+    ownedListStarts[(size_t)list + 1] += ownedListStarts[(size_t)list];
+
+  const auto total = ownedListStarts[(size_t)lists];
+  ownedVectors.resize((size_t)total * dimensions);
+  ownedItems.resize((size_t)total);
+  std::vector<juce::uint32> cursor(ownedListStarts.begin(),
+                                   ownedListStarts.end() - 1);
+  for (int list = 0; list < lists; ++list) {
+    for (auto i = previous.listStarts[list]; i < previous.listStarts[list + 1];
+         ++i) {
+      const int source = sourceMap[(size_t)previous.items[i].source];
+      if (source < 0)
+        continue;
+      const auto position = cursor[(size_t)list]++;
+      std::copy_n(previous.vectors + (size_t)i * dimensions, dimensions,
+                  ownedVectors.data() + (size_t)position * dimensions);
+      ownedItems[position] = previous.items[i];
+      ownedItems[position].source = source;
+    }
+  }
+  for (int i = 0; i < count; ++i) {
+    const auto position = cursor[(size_t)itemList[(size_t)i]]++;
+    std::copy_n(stagedVectors.data() + (size_t)i * dimensions, dimensions,
+                ownedVectors.data() + (size_t)position * dimensions);
+    ownedItems[position] = stagedItems[(size_t)i];
+  }
+
+  stagedVectors = std::vector<float>();
+  stagedItems = std::vector<Item>();
+  numLists = lists;
+  numTrainedItems = previous.numTrainedItems;
+  setViewToOwned();
+}
+
+void SimilarityIndex::clear() {
+  mappedFile.reset();
+  sourceNames.clear();
+  stagedVectors.clear();
+  stagedItems.clear();
+  ownedMean.clear();
+  ownedScale.clear();
+  ownedCentroids.clear();
+  ownedVectors.clear();
+  ownedListStarts.clear();
+  ownedItems.clear();
+  numItems = numLists = numTrainedItems = 0;
+  mean = scale = centroids = vectors = nullptr;
+  listStarts = nullptr;
+  items = nullptr;
+}
+
+void SimilarityIndex::normaliseStaged() {
+  for (size_t i = 0; i < stagedItems.size(); ++i)
+    for (int d = 0; d < dimensions; ++d) {
+      auto &value = stagedVectors[i * dimensions + d];
+      value = (value - ownedMean[(size_t)d]) / ownedScale[(size_t)d];
+    }
+}
+
+void SimilarityIndex::setViewToOwned() {
+  numItems = (int)ownedItems.size();
+  mean = ownedMean.data();
+  scale = ownedScale.data();
+  centroids = ownedCentroids.data();
+  listStarts = ownedListStarts.data();
+  vectors = ownedVectors.data();
+  items = ownedItems.data();
+}
+
+void SimilarityIndex::getFingerprint(int item, float *destination) const {
+  const float *vector = vectors + (size_t)item * dimensions;
+  for (int d = 0; d < dimensions; ++d)
+    destination[d] = vector[d] * scale[d] + mean[d];
+}
+
+void SimilarityIndex::search(const float *fingerprint, int k,
+                             std::vector<Match> &results,
+                             int numProbes) const {
+  results.clear();
+  if (numItems == 0 || numLists == 0 || k <= 0)
+    return;
+
+  float query[dimensions];
+  for (int d = 0; d < dimensions; ++d)
+    query[d] = (fingerprint[d] - mean[d]) / scale[d];
+
+  // Nearest lists by insertion into a small sorted array
+  const int probes = juce::jlimit(1, std::min(numLists, maxProbes), numProbes);
+  int probeList[maxProbes];
+  float probeDistance[maxProbes];
+  int numFound = 0;
+
+  for (int list = 0; list < numLists; ++list) {
+    const float distance =
+        squaredDistance(query, centroids + (size_t)list * dimensions);
+    if (numFound == probes && distance >= probeDistance[probes - 1])
+      continue;
+
+    int position = numFound < probes ? numFound++ : probes - 1;
+    while (position > 0 && probeDistance[position - 1] > distance) {
+      probeDistance[position] = probeDistance[position - 1];
+      probeList[position] = probeList[position - 1];
+      --position;
+    }
+    probeDistance[position] = distance;
+    probeList[position] = list;
+  }
+
+  // Exhaustive scan of the probed lists, keeping the best k in a max-heap
+  auto further = [](const Match &a, const Match &b) {
+    return a.distance < b.distance;
+  };
+
+  for (int p = 0; p < numFound; ++p) {
+    const int list = probeList[p];
+    for (auto i = listStarts[list]; i < listStarts[list + 1]; ++i) {
+      const float distance =
+          squaredDistance(query, vectors + (size_t)i * dimensions);
+
+      if ((int)results.size() < k) {
+        results.push_back({(int)i, distance});
+        std::push_heap(results.begin(), results.end(), further);
+      } else if (distance < results.front().distance) {
+        std::pop_heap(results.begin(), results.end(), further);
+        results.back() = {(int)i, distance};
+        std::push_heap(results.begin(), results.end(), further);
+      }
+    }
+  }
+
+  std::sort_heap(results.begin(), results.end(), further);
+  for (auto &match : results)
+    match.distance = std::sqrt(match.distance);
+}
+
+bool SimilarityIndex::save(const juce::File &file) const {
+  juce::MemoryOutputStream names;
+  for (auto &name : sourceNames) {
+    names << name;
+    names.writeByte(0);
+  }
+
+  Header header{};
+  header.magic = magic;
+  header.version = version;
+  header.dimensions = (juce::uint32)dimensions;
+  header.numItems = (juce::uint32)numItems;
+  header.numLists = (juce::uint32)numLists;
+  header.numSources = (juce::uint32)sourceNames.size();
+
+  // Every array starts 16-byte aligned so it can be used in place once mapped
+  juce::uint64 offset = alignTo16(sizeof(Header));
+  auto place = [&offset](juce::uint64 &field, size_t bytes) {
+    field = offset;
+    offset = alignTo16(offset + bytes);
+  };
+  place(header.meanOffset, sizeof(float) * dimensions);
+  place(header.scaleOffset, sizeof(float) * dimensions);
+  place(header.centroidOffset, sizeof(float) * (size_t)numLists * dimensions);
+  place(header.listOffset, sizeof(juce::uint32) * ((size_t)numLists + 1));
+  place(header.vectorOffset, sizeof(float) * (size_t)numItems * dimensions);
+  place(header.itemOffset, sizeof(Item) * (size_t)numItems);
+  place(header.namesOffset, names.getDataSize());
+  header.namesSize = names.getDataSize();
+
+  juce::TemporaryFile temp(file);
+  {
+    juce::FileOutputStream out(temp.getFile());
+    if (!out.openedOk())
+      return false;
+
+    auto writeAt = [&out](juce::uint64 position, const void *data,
+                          size_t bytes) {
+      while ((juce::uint64)out.getPosition() < position)
+        out.writeByte(0);
+      return bytes == 0 || out.write(data, bytes);
+    };
+
+    bool ok = writeAt(0, &header, sizeof(Header));
+    if (numItems > 0) {
+      ok = ok && writeAt(header.meanOffset, mean, sizeof(float) * dimensions);
+      ok = ok && writeAt(header.scaleOffset, scale, sizeof(float) * dimensions);
+      ok = ok && writeAt(header.centroidOffset, centroids,
+                         sizeof(float) * (size_t)numLists * dimensions);
+      ok = ok && writeAt(header.listOffset, listStarts,
+                         sizeof(juce::uint32) * ((size_t)numLists + 1));
+      ok = ok && writeAt(header.vectorOffset, vectors,
+                         sizeof(float) * (size_t)numItems * dimensions);
+      ok = ok && writeAt(header.itemOffset, items, sizeof(Item) * numItems);
+    }
+    ok = ok && writeAt(header.namesOffset, names.getData(), names.getDataSize());
+    out.flush();
+
+    if (!ok || out.getStatus().failed())
+      return false;
+  }
+
+  return temp.overwriteTargetFileWithTemporary();
+}
+
+bool SimilarityIndex::open(const juce::File &file) {
+  clear();
+  auto fail = [this] {
+    clear();
+    return false;
+  };
+
+  auto mapping = std::make_unique<juce::MemoryMappedFile>(
+      file, juce::MemoryMappedFile::readOnly);
+  const auto *base = static_cast<const char *>(mapping->getData());
+  const auto size = (juce::uint64)mapping->getSize();
+  if (base == nullptr || size < sizeof(Header))
+    return fail();
+
+  Header header;
+  std::memcpy(&header, base, sizeof(Header));
+  if (header.magic != magic || header.version != version ||
+      header.dimensions != (juce::uint32)dimensions)
+    return fail();
+
+  auto inBounds = [size](juce::uint64 offset, juce::uint64 bytes) {
+    return offset % 16 == 0 && offset <= size && bytes <= size - offset;
+  };
+  const juce::uint64 lists = header.numLists, count = header.numItems;
+  if (!inBounds(header.meanOffset, sizeof(float) * dimensions) ||
+      !inBounds(header.scaleOffset, sizeof(float) * dimensions) ||
+      !inBounds(header.centroidOffset, sizeof(float) * lists * dimensions) ||
+      !inBounds(header.listOffset, sizeof(juce::uint32) * (lists + 1)) ||
+      !inBounds(header.vectorOffset, sizeof(float) * count * dimensions) ||
+      !inBounds(header.itemOffset, sizeof(Item) * count) ||
+      !inBounds(header.namesOffset, header.namesSize))
+    return fail();
+
+  const auto *starts =
+      reinterpret_cast<const juce::uint32 *>(base + header.listOffset);
+  for (juce::uint64 list = 0; list < lists; ++list)
+    if (starts[list] > starts[list + 1])
+      return fail();
+  if (count > 0 && (starts[0] != 0 || starts[lists] != count))
+    return fail();
+
+  const auto *names = base + header.namesOffset;
+  for (juce::uint64 position = 0; position < header.namesSize;) {
+    const auto *end = static_cast<const char *>(
+        std::memchr(names + position, 0, header.namesSize - position));
+    if (end == nullptr)
+      return fail();
+    sourceNames.add(juce::String::fromUTF8(names + position,
+                                           (int)(end - (names + position))));
+    position = (juce::uint64)(end - names) + 1;
+  }
+
+  // Items are checked once here so searches never need to
+  const auto *mappedItems =
+      reinterpret_cast<const Item *>(base + header.itemOffset);
+  for (juce::uint64 i = 0; i < count; ++i)
+    if (mappedItems[i].source < 0 ||
+        mappedItems[i].source >= sourceNames.size())
+      return fail();
+
+  numItems = numTrainedItems = (int)count;
+  numLists = (int)lists;
+  mean = reinterpret_cast<const float *>(base + header.meanOffset);
+  scale = reinterpret_cast<const float *>(base + header.scaleOffset);
+  centroids = reinterpret_cast<const float *>(base + header.centroidOffset);
+  listStarts = starts;
+  vectors = reinterpret_cast<const float *>(base + header.vectorOffset);
+  items = mappedItems;
+  mappedFile = std::move(mapping);
+  return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "AudioAnalysis.h"
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+// Approximate nearest-neighbour search over slice fingerprints. Vectors are
+// z-scored per dimension and bucketed by a k-means coarse quantizer (an
+// inverted file); a query only scans the few buckets whose centroids are
+// nearest. A built index can be saved and later opened by memory-mapping the
+// file, in which case searches read straight from the mapping.
+class SimilarityIndex {
+public:
+  static constexpr int dimensions = AudioAnalysis::fingerprintSize;
+
+  struct Item {
+    juce::int32 source; // Index into the source names
+    juce::int32 start;  // Slice start in samples
+    juce::int32 length; // Slice length in samples
+  };
+
+  struct Match {
+    int item;
+    float distance;
+  };
+
+  SimilarityIndex() = default;
+
+  // Staging: collect slices, then build() replaces whatever was searchable
+  int addSource(const juce::String &name);
+  void add(int source, const AudioAnalysis::SliceFeatures &slices);
+  void add(int source, int start, int length, const float *fingerprint);
+
+  // numLists 0 picks roughly sqrt(numItems)
+  void build(int numLists = 0);
+  // Keeps previous' normalisation and centroids instead of training again:
+  // its items are carried over in their lists, except those whose source
+  // name was also added here, and only the staged items are assigned. Much
+  // cheaper than build(), but the lists drift as the library grows, so
+  // retrain once getNumItems() is well past getNumTrainedItems().
+  void build(const SimilarityIndex &previous);
+  void clear();
+
+  int getNumItems() const { return numItems; }
+  int getNumLists() const { return numLists; }
+  // Items the centroids were trained on (for an opened index, all of them)
+  int getNumTrainedItems() const { return numTrainedItems; }
+  int getNumSources() const { return sourceNames.size(); }
+  const Item &getItem(int item) const { return items[item]; }
+  const juce::String &getSourceName(int source) const {
+    return sourceNames.getReference(source);
+  }
+
+  // Writes the un-normalised fingerprint of item into destination
+  void getFingerprint(int item, float *destination) const;
+
+  // The k closest items to fingerprint, nearest first. More probes trade
+  // speed for recall.
+  void search(const float *fingerprint, int k, std::vector<Match> &results,
+              int numProbes = 8) const;
+
+  bool save(const juce::File &file) const;
+  bool open(const juce::File &file);
+
+private:
+  static constexpr juce::uint32 magic = 0x49535053; // "SPSI"
+  static constexpr juce::uint32 version = 2; // 2: short tail frames skipped
+
+  struct Header {
+    juce::uint32 magic, version, dimensions, numItems, numLists, numSources;
+    juce::uint64 meanOffset, scaleOffset, centroidOffset, listOffset,
+        vectorOffset, itemOffset, namesOffset, namesSize;
+  };
+
+  void setViewToOwned();
+  void normaliseStaged();
+
+  // Search view: points into the owned arrays or into the mapped file
+  int numItems = 0, numLists = 0, numTrainedItems = 0;
+  const float *mean = nullptr;
+  const float *scale = nullptr;
+  const float *centroids = nullptr;
+  const juce::uint32 *listStarts = nullptr; // numLists + 1 entries
+  const float *vectors = nullptr;           // List order, normalised
+  const Item *items = nullptr;              // List order
+  juce::StringArray sourceNames;
+
+  // Owned storage after build()
+  std::vector<float> ownedMean, ownedScale, ownedCentroids, ownedVectors;
+  std::vector<juce::uint32> ownedListStarts;
+  std::vector<Item> ownedItems;
+  std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+
+  // Staged input for the next build()
+  std::vector<float> stagedVectors;
+  std::vector<Item> stagedItems;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SimilarityIndex)
+};
@@ -0,0 +1,71 @@
+#include "Tracing.h"
+
+#if SAMPLER_PRO_TRACING
+
+#include <algorithm>
+#include <utility>
+
+Tracer &Tracer::getInstance() {
+  static Tracer instance;
+  return instance;
+}
+
+Tracer::Tracer()
+    : originTicks(juce::Time::getHighResolutionTicks()), spans(capacity) {}
+
+void Tracer::addSpan(const char *name, juce::int64 startTicks,
+                     juce::int64 endTicks, juce::int64 size) {
+  auto threadId =
+      (juce::int64)(juce::pointer_sized_int)juce::Thread::getCurrentThreadId();
+
+  const juce::SpinLock::ScopedLockType sl(lock);
+  spans[numRecorded++ % capacity] = {name, startTicks, endTicks, size,
+                                     threadId};
+}
+
+void Tracer::clear() {
+  const juce::SpinLock::ScopedLockType sl(lock);
+  numRecorded = 0;
+}
+
+bool Tracer::writeChromeTrace(const juce::File &file) {
+  // The replacement ring is allocated before taking the lock
+  std::vector<Span> snapshot(capacity);
+  size_t total;
+  {
+    const juce::SpinLock::ScopedLockType sl(lock);
+    snapshot.swap(spans);
+    total = std::exchange(numRecorded, (size_t)0);
+  }
+
+  // Oldest first
+  const size_t count = std::min(total, capacity);
+  const size_t first = total > capacity ? total % capacity : 0;
+
+  auto toMicros = [this](juce::int64 ticks) {
+    return juce::Time::highResolutionTicksToSeconds(ticks - originTicks) *
+           1.0e6;
+  };
+
+  // Complete ("X") events, one per span
+  juce::String json = "{\"traceEvents\":[\n";
+  for (size_t i = 0; i < count; ++i) {
+    const auto &span = snapshot[(first + i) % capacity];
+    const double start = toMicros(span.startTicks);
+    const double duration = toMicros(span.endTicks) - start;
+
+    json << "{\"name\":\"" << span.name << "\",\"cat\":\"analysis\""
+         << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.threadId
+         << ",\"ts\":" << juce::String(start, 3)
+         << ",\"dur\":" << juce::String(duration, 3)
+         << ",\"args\":{\"size\":" << span.size << "}}"
+         << (i + 1 < count ? ",\n" : "\n");
+  }
+  json << "],\"displayTimeUnit\":\"ms\""
+       << ",\"otherData\":{\"droppedSpans\":" << (juce::int64)(total - count)
+       << "}}\n";
+
+  return file.replaceWithText(json);
+}
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef SAMPLER_PRO_TRACING
+#define SAMPLER_PRO_TRACING 0
+#endif
+
+#if SAMPLER_PRO_TRACING
+
+#include <vector>
+
+// Collects timed spans from the load and analysis path so slow files can be
+// inspected in chrome://tracing or ui.perfetto.dev. Never used on the audio
+// thread; with SAMPLER_PRO_TRACING off the macros expand to nothing.
+// Spans go into a fixed ring, so a long session keeps only the latest
+// capacity of them and memory stays flat.
+class Tracer {
+public:
+  static constexpr size_t capacity = 65536;
+
+  static Tracer &getInstance();
+
+  void addSpan(const char *name, juce::int64 startTicks,
+               juce::int64 endTicks, juce::int64 size);
+  // Writes the spans recorded since the last export or clear() and starts
+  // over; the lock is only held to swap the ring out
+  bool writeChromeTrace(const juce::File &file);
+  void clear();
+
+  class ScopedSpan {
+  public:
+    ScopedSpan(const char *spanName, juce::int64 spanSize)
+        : name(spanName), size(spanSize),
+          startTicks(juce::Time::getHighResolutionTicks()) {}
+    ~ScopedSpan() {
+      Tracer::getInstance().addSpan(
+          name, startTicks, juce::Time::getHighResolutionTicks(), size);
+    }
+
+  private:
+    const char *name;
+    juce::int64 size;
+    juce::int64 startTicks;
+
+    JUCE_DECLARE_NON_COPYABLE(ScopedSpan)
+  };
+
+private:
+  Tracer();
+
+  struct Span {
+    const char *name; // Always a string literal
+    juce::int64 startTicks;
+    juce::int64 endTicks;
+    juce::int64 size;
+    juce::int64 threadId;
+  };
+
+  const juce::int64 originTicks;
+  juce::SpinLock lock;
+  std::vector<Span> spans; // Always capacity long
+  size_t numRecorded = 0;  // Since the last export; past capacity, the
+                           // oldest have been overwritten
+
+  JUCE_DECLARE_NON_COPYABLE(Tracer)
+};
+
+#define SAMPLER_TRACE_SCOPE(name, size)                                        \
+  Tracer::ScopedSpan JUCE_JOIN_MACRO(traceSpan_, __LINE__)(name,               \
+                                                           (juce::int64)(size))
+
+#else
+
+#define SAMPLER_TRACE_SCOPE(name, size)
+
+#endif
@@ -1,29 +1,40 @@
 #pragma once
 
+#include "WaveformPeaks.h"
+#include "WaveformTiles.h"
 #include <JuceHeader.h>
+#include <cmath>
 #include <functional>
+#include <memory>
 #include <vector>
 
-class WaveformComponent : public juce::Component,
-                          public juce::ChangeListener,
-                          public juce::Timer {
+class WaveformComponent : public juce::Component, public juce::Timer {
 public:
-  WaveformComponent(juce::AudioThumbnail &thumbnailToUse,
+  WaveformComponent(std::shared_ptr<const WaveformPeaks> peaksToUse,
                     std::vector<int> *onsetsToUse)
-      : thumbnail(thumbnailToUse), onsets(onsetsToUse) {
-    thumbnail.addChangeListener(this);
+      : onsets(onsetsToUse) {
+    setPeaks(std::move(peaksToUse));
+    tiles.onTilesReady = [this] { repaint(); };
     startTimerHz(60);
   }
 
-  WaveformComponent() : thumbnail(dummyThumbnail), onsets(&dummyOnsets) {
+  WaveformComponent() : onsets(&dummyOnsets) {
+    setPeaks(nullptr);
+    tiles.onTilesReady = [this] { repaint(); };
     startTimerHz(60);
   }
 
+  void setPeaks(std::shared_ptr<const WaveformPeaks> newPeaks) {
+    peaks = newPeaks != nullptr ? std::move(newPeaks) : dummyPeaks;
+    tiles.setPeaks(peaks);
+    repaint();
+  }
   void setOnsets(std::vector<int> *newOnsets) {
     onsets = newOnsets;
     repaint();
   }
   std::function<void(int)> onSliceClicked;
+  std::function<void()> onOnsetsEdited; // While an onset is dragged
 
   void setSampleRate(double newSampleRate) { sampleRate = newSampleRate; }
   void setPlayheadTime(double time) {
@@ -31,12 +42,12 @@ public:
     repaint();
   }
   void setZoomLevel(double newZoom) {
-    zoomLevel = juce::jlimit(1.0, 100.0, newZoom);
+    zoomLevel = quantiseZoom(newZoom);
     repaint();
   }
   double getZoomLevel() const { return zoomLevel; }
 
-  ~WaveformComponent() override { thumbnail.removeChangeListener(this); }
+  ~WaveformComponent() override = default;
 
   void paint(juce::Graphics &g) override {
     auto bounds = getLocalBounds();
@@ -44,18 +55,20 @@ public:
     g.setColour(juce::Colour::greyLevel(0.1f));
     g.fillRoundedRectangle(bounds.toFloat(), 4.0f);
 
-    if (thumbnail.getNumChannels() == 0) {
+    if (peaks->isEmpty()) {
       g.setColour(juce::Colours::white.withAlpha(0.3f));
       g.drawFittedText("Drop a sample here", bounds,
                        juce::Justification::centred, 1);
     } else {
-      double totalDuration = thumbnail.getTotalLength();
+      double totalDuration = peaks->getLengthInSeconds();
       double displayedDuration = totalDuration / zoomLevel;
       double startTime = scrollPos * (totalDuration - displayedDuration);
       double endTime = startTime + displayedDuration;
 
-      g.setColour(juce::Colours::lightgreen.withAlpha(0.8f));
-      thumbnail.drawChannels(g, bounds.reduced(2), startTime, endTime, 1.0f);
+      // Pre-rendered off the message thread; see WaveformTileCache
+      tiles.draw(g, bounds.reduced(2), startTime,
+                 juce::roundToInt(zoomLevel *
+                                  WaveformTileCache::zoomStepsPerUnit));
 
       g.setColour(juce::Colours::white.withAlpha(0.2f));
 
@@ -85,7 +98,7 @@ public:
 
   void mouseDown(const juce::MouseEvent &event) override {
     auto bounds = getLocalBounds();
-    double totalDuration = thumbnail.getTotalLength();
+    double totalDuration = peaks->getLengthInSeconds();
     if (totalDuration <= 0)
       return;
 
@@ -134,7 +147,7 @@ public:
       return;
 
     auto bounds = getLocalBounds();
-    double totalDuration = thumbnail.getTotalLength();
+    double totalDuration = peaks->getLengthInSeconds();
     double displayedDuration = totalDuration / zoomLevel;
     double startTime = scrollPos * (totalDuration - displayedDuration);
 
@@ -144,8 +157,10 @@ public:
     int dragSample = (int)(dragTime * (sampleRate > 0 ? sampleRate : 44100.0));
 
     if (onsets != nullptr) {
-      (*onsets)[draggingOnsetIndex] = juce::jlimit(
-          0, (int)thumbnail.getTotalLength() * (int)sampleRate, dragSample);
+      (*onsets)[draggingOnsetIndex] =
+          juce::jlimit(0, (int)peaks->getNumSamples(), dragSample);
+      if (onOnsetsEdited)
+        onOnsetsEdited();
       repaint();
     }
   }
@@ -156,11 +171,11 @@ public:
 
   void mouseWheelMove(const juce::MouseEvent &,
                       const juce::MouseWheelDetails &wheel) override {
-    if (thumbnail.getTotalLength() <= 0)
+    if (peaks->getLengthInSeconds() <= 0)
       return;
 
     if (wheel.deltaY != 0) {
-      zoomLevel = juce::jlimit(1.0, 100.0, zoomLevel + wheel.deltaY * 5.0);
+      zoomLevel = quantiseZoom(zoomLevel + wheel.deltaY * 5.0);
       if (onZoomChanged)
         onZoomChanged();
     }
@@ -172,17 +187,18 @@ public:
     repaint();
   }
 
-  void changeListenerCallback(juce::ChangeBroadcaster *source) override {
-    if (source == &thumbnail)
-      repaint();
-  }
-
   void timerCallback() override {
     // Parent should call setPlayheadTime
   }
 
 private:
-  juce::AudioThumbnail &thumbnail;
+  // Whole tile-cache zoom steps, so tiles are reused while the zoom holds
+  static double quantiseZoom(double zoom) {
+    constexpr double steps = WaveformTileCache::zoomStepsPerUnit;
+    return std::round(juce::jlimit(1.0, 100.0, zoom) * steps) / steps;
+  }
+
+  std::shared_ptr<const WaveformPeaks> peaks;
   std::vector<int> *onsets;
   double sampleRate = 44100.0;
   double playheadTime = 0.0;
@@ -190,11 +206,12 @@ private:
   double scrollPos = 0.0; // 0.0 to 1.0
   int draggingOnsetIndex = -1;
 
-  // Dummies for default constructor
-  juce::AudioFormatManager dummyManager;
-  juce::AudioThumbnailCache dummyCache{1};
-  juce::AudioThumbnail dummyThumbnail{1, dummyManager, dummyCache};
+  // Stand-ins while nothing is loaded
+  std::shared_ptr<const WaveformPeaks> dummyPeaks =
+      std::make_shared<WaveformPeaks>();
   std::vector<int> dummyOnsets;
 
+  WaveformTileCache tiles;
+
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformComponent)
 };
@@ -0,0 +1,170 @@
+#include "WaveformPeaks.h"
+#include "AnalysisKernels.h"
+#include "Parallel.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <cmath>
+
+void WaveformPeaks::build(const juce::AudioBuffer<float> &buffer,
+                          double newSampleRate) {
+  SAMPLER_TRACE_SCOPE("buildPeaks", buffer.getNumSamples());
+
+  setLayout(buffer.getNumChannels(), buffer.getNumSamples(), newSampleRate);
+  ownedMinimums.resize(dataSize);
+  ownedMaximums.resize(dataSize);
+  minimums = ownedMinimums.data();
+  maximums = ownedMaximums.data();
+  viewOwner.reset();
+
+  // Chunks of peaks rather than single peaks keep per-task overhead small
+  const int peaksPerChunk = 1024;
+  const int chunksPerChannel = (numPeaks + peaksPerChunk - 1) / peaksPerChunk;
+
+  parallelFor(numChannels * chunksPerChannel, [&](int task, int) {
+    const int channel = task / chunksPerChannel;
+    const int firstPeak = (task % chunksPerChannel) * peaksPerChunk;
+    const int lastPeak = std::min(numPeaks, firstPeak + peaksPerChunk);
+
+    auto *data = buffer.getReadPointer(channel);
+    float *mins = ownedMinimums.data() + (size_t)channel * (size_t)numPeaks;
+    float *maxs = ownedMaximums.data() + (size_t)channel * (size_t)numPeaks;
+
+    for (int peak = firstPeak; peak < lastPeak; ++peak) {
+      const int start = peak * samplesPerPeak;
+      const int count = (int)std::min((juce::int64)samplesPerPeak,
+                                      numSamples - (juce::int64)start);
+      auto range = AnalysisKernels::findMinAndMax(data + start, count);
+      mins[peak] = range.getStart();
+      maxs[peak] = range.getEnd();
+    }
+  });
+
+  for (int level = 1; level < getNumLevels(); ++level) {
+    const int count = getNumPeaks(level);
+    const int below = getNumPeaks(level - 1);
+
+    for (int channel = 0; channel < numChannels; ++channel) {
+      const float *lowerMins = getMinimums(channel, level - 1);
+      const float *lowerMaxs = getMaximums(channel, level - 1);
+      float *mins = ownedMinimums.data() + getOffset(channel, level);
+      float *maxs = ownedMaximums.data() + getOffset(channel, level);
+
+      for (int peak = 0; peak < count; ++peak) {
+        const int first = 2 * peak;
+        const int second = juce::jmin(first + 1, below - 1);
+        mins[peak] = std::min(lowerMins[first], lowerMins[second]);
+        maxs[peak] = std::max(lowerMaxs[first], lowerMaxs[second]);
+      }
+    }
+  }
+}
+
+void WaveformPeaks::setLayout(int newNumChannels, juce::int64 newNumSamples,
+                              double newSampleRate) {
+  numChannels = newNumChannels;
+  numSamples = newNumSamples;
+  sampleRate = newSampleRate;
+  numPeaks = numChannels > 0
+                 ? (int)((numSamples + samplesPerPeak - 1) / samplesPerPeak)
+                 : 0;
+
+  // Levels down to a single entry; together they add about one more base
+  levelOffsets.clear();
+  dataSize = 0;
+  for (int level = 0; numPeaks > 0; ++level) {
+    levelOffsets.push_back(dataSize);
+    dataSize += (size_t)numChannels * (size_t)getNumPeaks(level);
+    if (getNumPeaks(level) <= 1)
+      break;
+  }
+}
+
+void WaveformPeaks::setView(int newNumChannels, juce::int64 newNumSamples,
+                            double newSampleRate, const float *newMinimums,
+                            const float *newMaximums,
+                            std::shared_ptr<const void> owner) {
+  setLayout(newNumChannels, newNumSamples, newSampleRate);
+  ownedMinimums = {};
+  ownedMaximums = {};
+  minimums = newMinimums;
+  maximums = newMaximums;
+  viewOwner = std::move(owner);
+}
+
+void WaveformPeaks::copyFrom(const WaveformPeaks &other) {
+  setLayout(other.numChannels, other.numSamples, other.sampleRate);
+  ownedMinimums.assign(other.minimums, other.minimums + dataSize);
+  ownedMaximums.assign(other.maximums, other.maximums + dataSize);
+  minimums = ownedMinimums.data();
+  maximums = ownedMaximums.data();
+  viewOwner.reset();
+}
+
+void WaveformPeaks::clear() {
+  setLayout(0, 0, sampleRate);
+  ownedMinimums = {};
+  ownedMaximums = {};
+  minimums = maximums = nullptr;
+  viewOwner.reset();
+}
+
+void WaveformPeaks::drawChannels(juce::Graphics &g, juce::Rectangle<int> area,
+                                 double startTime, double endTime,
+                                 float verticalZoomFactor) const {
+  if (isEmpty() || area.isEmpty() || endTime <= startTime)
+    return;
+
+  const double peaksPerSecond = sampleRate / samplesPerPeak;
+  const double peaksPerPixel =
+      (endTime - startTime) * peaksPerSecond / area.getWidth();
+
+  // The coarsest level that still has an entry for every pixel
+  int level = 0;
+  while (level + 1 < getNumLevels() && (double)(2 << level) <= peaksPerPixel)
+    ++level;
+
+  const double levelScale = 1.0 / (double)(1 << level);
+  const double firstPeak = startTime * peaksPerSecond * levelScale;
+  const double entriesPerPixel = peaksPerPixel * levelScale;
+  const int levelPeaks = getNumPeaks(level);
+  const int channelHeight = area.getHeight() / numChannels;
+
+  juce::RectangleList<float> columns;
+  columns.ensureStorageAllocated(area.getWidth());
+
+  for (int channel = 0; channel < numChannels; ++channel) {
+    auto channelArea = area.removeFromTop(channelHeight).toFloat();
+    const float centreY = channelArea.getCentreY();
+    const float halfHeight = channelArea.getHeight() * 0.5f *
+                             verticalZoomFactor;
+    const float *mins = getMinimums(channel, level);
+    const float *maxs = getMaximums(channel, level);
+
+    columns.clear();
+
+    for (int x = 0; x < (int)channelArea.getWidth(); ++x) {
+      const double from = firstPeak + x * entriesPerPixel;
+      const int first = juce::jmax(0, (int)from);
+      if (first >= levelPeaks)
+        break;
+
+      const int last = juce::jmin(
+          levelPeaks,
+          juce::jmax(first + 1, (int)std::ceil(from + entriesPerPixel)));
+
+      float low = mins[first], high = maxs[first];
+      for (int p = first + 1; p < last; ++p) {
+        low = std::min(low, mins[p]);
+        high = std::max(high, maxs[p]);
+      }
+
+      const float top = centreY - juce::jlimit(-1.0f, 1.0f, high) * halfHeight;
+      const float bottom =
+          centreY - juce::jlimit(-1.0f, 1.0f, low) * halfHeight;
+      columns.addWithoutMerging({channelArea.getX() + (float)x, top, 1.0f,
+                                 juce::jmax(1.0f, bottom - top)});
+    }
+
+    g.fillRectList(columns);
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+// Min/max overview of a decoded buffer, built straight from the samples the
+// engine already holds so the file is never decoded a second time. Above the
+// base level sits a pyramid where each level halves the one below, so any
+// span can be drawn from about one entry per pixel. The pyramid is either
+// owned or a view onto memory held elsewhere, such as a mapped session.
+class WaveformPeaks {
+public:
+  static constexpr int samplesPerPeak = 256;
+
+  WaveformPeaks() = default;
+
+  // Splits the buffer into chunks and scans them on the ParallelPool
+  void build(const juce::AudioBuffer<float> &buffer, double sampleRate);
+  // Uses minimums and maximums in place, laid out as getMinimumData() and
+  // getMaximumData() would be for the same shape; owner keeps them alive
+  void setView(int numChannels, juce::int64 numSamples, double sampleRate,
+               const float *minimums, const float *maximums,
+               std::shared_ptr<const void> owner);
+  // Owned copy of other, view or not
+  void copyFrom(const WaveformPeaks &other);
+  void clear();
+
+  bool isEmpty() const { return numPeaks == 0; }
+  bool isView() const { return viewOwner != nullptr; }
+  int getNumChannels() const { return numChannels; }
+  int getNumPeaks() const { return numPeaks; }
+  juce::int64 getNumSamples() const { return numSamples; }
+  double getSampleRate() const { return sampleRate; }
+  double getLengthInSeconds() const {
+    return sampleRate > 0 ? (double)numSamples / sampleRate : 0.0;
+  }
+
+  // Level 0 is samplesPerPeak per entry, level n is samplesPerPeak << n
+  int getNumLevels() const { return (int)levelOffsets.size(); }
+  int getNumPeaks(int level) const {
+    return (int)(((juce::int64)numPeaks + (1 << level) - 1) >> level);
+  }
+
+  const float *getMinimums(int channel, int level = 0) const {
+    return minimums + getOffset(channel, level);
+  }
+  const float *getMaximums(int channel, int level = 0) const {
+    return maximums + getOffset(channel, level);
+  }
+
+  // The whole pyramid, getDataSize() entries each, for serialisation
+  size_t getDataSize() const { return dataSize; }
+  const float *getMinimumData() const { return minimums; }
+  const float *getMaximumData() const { return maximums; }
+
+  // Same contract as juce::AudioThumbnail::drawChannels
+  void drawChannels(juce::Graphics &g, juce::Rectangle<int> area,
+                    double startTime, double endTime,
+                    float verticalZoomFactor) const;
+
+private:
+  void setLayout(int newNumChannels, juce::int64 newNumSamples,
+                 double newSampleRate);
+  size_t getOffset(int channel, int level) const {
+    return levelOffsets[(size_t)level] +
+           (size_t)channel * (size_t)getNumPeaks(level);
+  }
+
+  int numChannels = 0;
+  int numPeaks = 0;
+  juce::int64 numSamples = 0;
+  double sampleRate = 0.0;
+
+  // Level-major, then channel-major: levelOffsets[level] +
+  // channel * getNumPeaks(level) + peakIndex
+  std::vector<size_t> levelOffsets;
+  size_t dataSize = 0;
+
+  // View: points into the owned arrays or into memory kept by viewOwner
+  const float *minimums = nullptr;
+  const float *maximums = nullptr;
+  std::vector<float> ownedMinimums, ownedMaximums;
+  std::shared_ptr<const void> viewOwner;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformPeaks)
+};
@@ -0,0 +1,213 @@
+#include "WaveformTiles.h"
+#include <algorithm>
+#include <cmath>
+
+WaveformTileCache::WaveformTileCache() : juce::Thread("WaveformTileThread") {
+  tiles.reserve(maxTiles);
+  startThread();
+}
+
+WaveformTileCache::~WaveformTileCache() {
+  cancelPendingUpdate();
+  signalThreadShouldExit();
+  notify();
+  stopThread(4000);
+}
+
+void WaveformTileCache::setPeaks(std::shared_ptr<const WaveformPeaks> newPeaks) {
+  const juce::ScopedLock sl(lock);
+  if (newPeaks == peaks)
+    return;
+
+  peaks = std::move(newPeaks);
+  ++generation;
+  tiles.clear();
+  pending.clear();
+  overview = {};
+  requestedHeight = 0;
+}
+
+void WaveformTileCache::setColour(juce::Colour newColour) {
+  const juce::ScopedLock sl(lock);
+  if (newColour == colour)
+    return;
+
+  colour = newColour;
+  ++generation;
+  tiles.clear();
+  overview = {};
+  requestedHeight = 0;
+}
+
+void WaveformTileCache::draw(juce::Graphics &g, juce::Rectangle<int> area,
+                             double startTime, int zoomStep) {
+  if (area.isEmpty() || zoomStep <= 0)
+    return;
+
+  const juce::ScopedLock sl(lock);
+  if (peaks == nullptr || peaks->isEmpty())
+    return;
+
+  const double duration = peaks->getLengthInSeconds();
+  const auto makeKey = [&](int index) {
+    return TileKey{zoomStep, area.getWidth(), area.getHeight(), index};
+  };
+  const double pixelsPerSecond = getPixelsPerSecond(makeKey(0), duration);
+  const double startPixel = startTime * pixelsPerSecond;
+  const int firstTile = (int)std::floor(startPixel / tileWidth);
+  const int lastTile =
+      (int)std::floor((startPixel + area.getWidth() - 1) / tileWidth);
+  const int finalTile = (int)(duration * pixelsPerSecond / tileWidth);
+
+  if ((overview.isNull() || overview.getHeight() != area.getHeight()) &&
+      requestedHeight != area.getHeight())
+    overviewHeight = requestedHeight = area.getHeight();
+
+  g.saveState();
+  g.reduceClipRegion(area);
+  g.setOpacity(1.0f);
+
+  wanted.clear();
+  for (int index = firstTile; index <= lastTile; ++index) {
+    const auto key = makeKey(index);
+    const int x =
+        area.getX() + (int)std::round(index * tileWidth - startPixel);
+
+    if (auto *tile = findTile(key)) {
+      g.drawImageAt(tile->image, x, area.getY());
+      continue;
+    }
+
+    if (!(rendering && key == renderingKey))
+      wanted.push_back(key);
+
+    // Stretch the overview's matching span over the gap meanwhile
+    if (overview.isValid()) {
+      const double overviewPerSecond = overview.getWidth() / duration;
+      const double tileStart = index * tileWidth / pixelsPerSecond;
+      const int sourceX = juce::jlimit(0, overview.getWidth() - 1,
+                                       (int)(tileStart * overviewPerSecond));
+      const int sourceWidth = juce::jlimit(
+          1, overview.getWidth() - sourceX,
+          (int)std::ceil(tileWidth / pixelsPerSecond * overviewPerSecond));
+      g.drawImage(overview, x, area.getY(), tileWidth, area.getHeight(),
+                  sourceX, 0, sourceWidth, overview.getHeight());
+    }
+  }
+
+  g.restoreState();
+
+  // Neighbours last, so what is on screen is always rendered first
+  for (int index : {lastTile + 1, firstTile - 1}) {
+    const auto key = makeKey(index);
+    if (index >= 0 && index <= finalTile && findTile(key) == nullptr &&
+        !(rendering && key == renderingKey))
+      wanted.push_back(key);
+  }
+
+  // Whatever was queued for an earlier view is no longer wanted
+  pending = wanted;
+  if (!pending.empty() || overviewHeight > 0)
+    notify();
+}
+
+const WaveformTileCache::Tile *WaveformTileCache::findTile(const TileKey &key) {
+  for (auto &tile : tiles) {
+    if (tile.key == key) {
+      tile.lastUsed = ++useCounter;
+      return &tile;
+    }
+  }
+  return nullptr;
+}
+
+void WaveformTileCache::run() {
+  while (!threadShouldExit()) {
+    std::shared_ptr<const WaveformPeaks> source;
+    juce::Colour tileColour;
+    juce::uint32 jobGeneration;
+    TileKey key;
+    int height = 0;
+
+    {
+      const juce::ScopedLock sl(lock);
+      source = peaks;
+      tileColour = colour;
+      jobGeneration = generation;
+
+      if (source == nullptr || source->isEmpty()) {
+        pending.clear();
+        overviewHeight = 0;
+      } else if (overviewHeight > 0) {
+        height = std::exchange(overviewHeight, 0);
+      } else if (!pending.empty()) {
+        key = pending.front();
+        pending.erase(pending.begin());
+        renderingKey = key;
+        rendering = true;
+      }
+    }
+
+    if (height > 0) {
+      auto image = renderOverview(*source, height, tileColour);
+
+      const juce::ScopedLock sl(lock);
+      if (generation == jobGeneration)
+        overview = image;
+    } else if (key.height > 0) {
+      auto image = renderTile(*source, key, tileColour);
+
+      const juce::ScopedLock sl(lock);
+      rendering = false;
+      if (generation != jobGeneration)
+        continue;
+
+      if ((int)tiles.size() >= maxTiles) {
+        auto oldest = std::min_element(
+            tiles.begin(), tiles.end(), [](const Tile &a, const Tile &b) {
+              return a.lastUsed < b.lastUsed;
+            });
+        tiles.erase(oldest);
+      }
+      tiles.push_back({key, image, ++useCounter});
+    } else {
+      wait(-1);
+      continue;
+    }
+
+    triggerAsyncUpdate();
+  }
+}
+
+void WaveformTileCache::handleAsyncUpdate() {
+  if (onTilesReady != nullptr)
+    onTilesReady();
+}
+
+juce::Image WaveformTileCache::renderTile(const WaveformPeaks &source,
+                                          const TileKey &key,
+                                          juce::Colour tileColour) const {
+  juce::Image image(juce::Image::ARGB, tileWidth, key.height, true,
+                    juce::SoftwareImageType());
+  juce::Graphics g(image);
+  g.setColour(tileColour);
+
+  const double pixelsPerSecond =
+      getPixelsPerSecond(key, source.getLengthInSeconds());
+  const double start = key.index * tileWidth / pixelsPerSecond;
+  source.drawChannels(g, {0, 0, tileWidth, key.height}, start,
+                      start + tileWidth / pixelsPerSecond, 1.0f);
+  return image;
+}
+
+juce::Image WaveformTileCache::renderOverview(const WaveformPeaks &source,
+                                              int height,
+                                              juce::Colour tileColour) const {
+  juce::Image image(juce::Image::ARGB, overviewWidth, height, true,
+                    juce::SoftwareImageType());
+  juce::Graphics g(image);
+  g.setColour(tileColour);
+  source.drawChannels(g, {0, 0, overviewWidth, height}, 0.0,
+                      source.getLengthInSeconds(), 1.0f);
+  return image;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "WaveformPeaks.h"
+#include <JuceHeader.h>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Rasterises the waveform into fixed-width image tiles on a background
+// thread, so painting only blits. Tiles are keyed by zoom step, view size and
+// position on the timeline, all integers so that scrolling keeps hitting the
+// same tiles, and the most recently used ones are kept. Until a tile arrives
+// its span is drawn from a low-resolution overview of the whole file.
+class WaveformTileCache : private juce::Thread, private juce::AsyncUpdater {
+public:
+  static constexpr int tileWidth = 256;
+  static constexpr int maxTiles = 96;
+  static constexpr int overviewWidth = 2048;
+  // Zoom is given in these fractions of "whole file fits the width"
+  static constexpr int zoomStepsPerUnit = 8;
+
+  WaveformTileCache();
+  ~WaveformTileCache() override;
+
+  // Drops every tile, unless these are the peaks already shown; rendering
+  // restarts from the overview
+  void setPeaks(std::shared_ptr<const WaveformPeaks> newPeaks);
+  void setColour(juce::Colour newColour);
+
+  // Message thread. Blits what is cached for the view starting at startTime,
+  // zoomed in zoomStep / zoomStepsPerUnit times, and queues the rest plus
+  // one tile either side for scrolling.
+  void draw(juce::Graphics &g, juce::Rectangle<int> area, double startTime,
+            int zoomStep);
+
+  // Message thread, whenever new tiles are ready to be drawn
+  std::function<void()> onTilesReady;
+
+private:
+  struct TileKey {
+    int zoomStep = 0;
+    int width = 0; // Of the whole view, which with zoomStep sets the scale
+    int height = 0;
+    int index = 0;
+
+    bool operator==(const TileKey &other) const {
+      return zoomStep == other.zoomStep && width == other.width &&
+             height == other.height && index == other.index;
+    }
+  };
+
+  static double getPixelsPerSecond(const TileKey &key, double duration) {
+    return key.width * (double)key.zoomStep / (zoomStepsPerUnit * duration);
+  }
+
+  struct Tile {
+    TileKey key;
+    juce::Image image;
+    juce::uint32 lastUsed = 0;
+  };
+
+  void run() override;
+  void handleAsyncUpdate() override;
+
+  juce::Image renderTile(const WaveformPeaks &source, const TileKey &key,
+                         juce::Colour colour) const;
+  juce::Image renderOverview(const WaveformPeaks &source, int height,
+                             juce::Colour colour) const;
+  const Tile *findTile(const TileKey &key);
+
+  // Shared with the render thread
+  juce::CriticalSection lock;
+  std::shared_ptr<const WaveformPeaks> peaks;
+  juce::Colour colour{juce::Colours::lightgreen.withAlpha(0.8f)};
+  juce::uint32 generation = 0;  // Bumped whenever cached images go stale
+  std::vector<TileKey> pending; // Most wanted first
+  std::vector<Tile> tiles;
+  juce::Image overview;
+  int overviewHeight = 0;  // Height still to render; 0 when none is queued
+  int requestedHeight = 0; // Last overview height asked for
+  TileKey renderingKey;
+  bool rendering = false;
+  juce::uint32 useCounter = 0;
+
+  std::vector<TileKey> wanted; // draw() scratch, message thread only
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformTileCache)
+};